@@ -1,11 +1,24 @@
 #include "stdafx.h"
 #include "Calibration.h"
+#include "CalibrationMath.h"
 #include "Configuration.h"
+#include "DeviceRegistry.h"
 #include "IPCClient.h"
+#include "PoseSampler.h"
+#include "TraceRecorder.h"
 
 #include <string>
 #include <vector>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include <Eigen/Dense>
 
@@ -18,38 +31,6 @@ void InitCalibrator()
 	Driver.Connect();
 }
 
-struct Pose
-{
-	Eigen::Matrix3d rot;
-	Eigen::Vector3d trans;
-
-	Pose() { }
-	Pose(vr::HmdMatrix34_t hmdMatrix)
-	{
-		for (int i = 0; i < 3; i++) {
-			for (int j = 0; j < 3; j++) {
-				rot(i,j) = hmdMatrix.m[i][j];
-			}
-		}
-		trans = Eigen::Vector3d(hmdMatrix.m[0][3], hmdMatrix.m[1][3], hmdMatrix.m[2][3]);
-	}
-	Pose(double x, double y, double z) : trans(Eigen::Vector3d(x,y,z)) { }
-};
-
-struct Sample
-{
-	Pose ref, target;
-	bool valid;
-	Sample() : valid(false) { }
-	Sample(Pose ref, Pose target) : valid(true), ref(ref), target(target) { }
-};
-
-struct DSample
-{
-	bool valid;
-	Eigen::Vector3d ref, target;
-};
-
 bool StartsWith(const std::string &str, const std::string &prefix)
 {
 	if (str.length() < prefix.length())
@@ -66,157 +47,261 @@ bool EndsWith(const std::string &str, const std::string &suffix)
 	return str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
 }
 
-Eigen::Vector3d AxisFromRotationMatrix3(Eigen::Matrix3d rot)
+// Folds the samples of one calibration phase into an accumulator on a background thread, so the
+// pairwise work and the solves never hold up sampling, rendering or overlay events.
+//
+// CalibrationTick hands it samples as they are collected and polls it like a future: Progress()
+// counts the samples folded in so far, Estimate() returns the latest intermediate solution, and
+// once the full sample count has been folded in, the final fit runs and Ready() becomes true. An
+// adaptive job treats the sample count as a cap, and stops early once the estimate has Converged().
+// A robust job also keeps its samples, for the RANSAC and reweighting passes of SolveRobust.
+// Destroying the job cancels it.
+template<class Accumulator>
+class SolveJob
 {
-	return Eigen::Vector3d(rot(2,1) - rot(1,2), rot(0,2) - rot(2,0), rot(1,0) - rot(0,1));
-}
+public:
+	typedef decltype(std::declval<Accumulator>().Solve()) Estimate;
 
-double AngleFromRotationMatrix3(Eigen::Matrix3d rot)
-{
-	return acos((rot(0,0) + rot(1,1) + rot(2,2) - 1.0) / 2.0);
-}
+	SolveJob(size_t sampleCount, bool robust, bool adaptive) : sampleCount(sampleCount), robust(robust), adaptive(adaptive), thread(&SolveJob::Run, this) { }
 
-DSample DeltaRotationSamples(Sample s1, Sample s2)
-{
-	// Difference in rotation between samples.
-	auto dref = s1.ref.rot * s2.ref.rot.transpose();
-	auto dtarget = s1.target.rot * s2.target.rot.transpose();
+	~SolveJob()
+	{
+		Cancel();
+		thread.join();
+	}
 
-	// When stuck together, the two tracked objects rotate as a pair,
-	// therefore their axes of rotation must be equal between any given pair of samples.
-	DSample ds;
-	ds.ref = AxisFromRotationMatrix3(dref);
-	ds.target = AxisFromRotationMatrix3(dtarget);
+	void AddSample(const Sample &sample)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push_back(sample);
+		wake.notify_one();
+	}
 
-	// Reject samples that were too close to each other.
-	auto refA = AngleFromRotationMatrix3(dref);
-	auto targetA = AngleFromRotationMatrix3(dtarget);
-	ds.valid = refA > 0.4 && targetA > 0.4 && ds.ref.norm() > 0.01 && ds.target.norm() > 0.01;
+	void Cancel()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+		wake.notify_one();
+	}
 
-	ds.ref.normalize();
-	ds.target.normalize();
-	return ds;
-}
+	// No more samples are coming, so it solves with those it has.
+	void Finish()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		complete = true;
+		wake.notify_one();
+	}
 
-Eigen::Vector3d CalibrateRotation(const std::vector<Sample> &samples)
-{
-	std::vector<DSample> deltas;
+	size_t Progress() const
+	{
+		return processed;
+	}
 
-	for (size_t i = 0; i < samples.size(); i++)
+	bool Ready() const
 	{
-		for (size_t j = 0; j < i; j++)
-		{
-			auto delta = DeltaRotationSamples(samples[i], samples[j]);
-			if (delta.valid)
-				deltas.push_back(delta);
-		}
+		return finished;
 	}
-	char buf[256];
-	snprintf(buf, sizeof buf, "Got %zd samples with %zd delta samples\n", samples.size(), deltas.size());
-	CalCtx.Log(buf);
 
-	// Kabsch algorithm
+	// Whether it converged before the full sample count.
+	bool StoppedEarly() const
+	{
+		return stoppedEarly;
+	}
 
-	Eigen::MatrixXd refPoints(deltas.size(), 3), targetPoints(deltas.size(), 3);
-	Eigen::Vector3d refCentroid(0,0,0), targetCentroid(0,0,0);
+	const Accumulator &Get() const
+	{
+		return accumulator;
+	}
 
-	for (size_t i = 0; i < deltas.size(); i++)
+	const Estimate &Result() const
 	{
-		refPoints.row(i) = deltas[i].ref;
-		refCentroid += deltas[i].ref;
+		return result;
+	}
 
-		targetPoints.row(i) = deltas[i].target;
-		targetCentroid += deltas[i].target;
+	bool Robust() const
+	{
+		return robust;
 	}
 
-	refCentroid /= (double) deltas.size();
-	targetCentroid /= (double) deltas.size();
+	// Share of the data the robust fit treated as inliers.
+	double InlierRatio() const
+	{
+		return inlierRatio;
+	}
 
-	for (size_t i = 0; i < deltas.size(); i++)
+	bool LatestEstimate(Estimate &out)
 	{
-		refPoints.row(i) -= refCentroid;
-		targetPoints.row(i) -= targetCentroid;
+		std::lock_guard<std::mutex> lock(mutex);
+		out = estimate;
+		return hasEstimate;
 	}
 
-	auto crossCV = refPoints.transpose() * targetPoints;
+private:
+	void Run()
+	{
+		std::vector<Sample> batch;
+
+		while (processed < sampleCount && !stoppedEarly)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return cancelled || complete || !pending.empty(); });
+				if (cancelled)
+					return;
+				if (pending.empty())
+					break;
+
+				batch.swap(pending);
+			}
+
+			accumulator.AddSamples(batch.data(), batch.size());
+			if (robust)
+				samples.insert(samples.end(), batch.begin(), batch.end());
+
+			processed += batch.size();
+			batch.clear();
+
+			if (accumulator.CanSolve())
+			{
+				auto solved = accumulator.Solve();
+				if (adaptive && HasConverged(solved))
+					stoppedEarly = true;
+
+				std::lock_guard<std::mutex> lock(mutex);
+				estimate = solved;
+				hasEstimate = true;
+			}
+		}
 
-	Eigen::BDCSVD<Eigen::MatrixXd> bdcsvd;
-	auto svd = bdcsvd.compute(crossCV, Eigen::ComputeThinU | Eigen::ComputeThinV);
+		if (robust)
+			result = SolveRobust(accumulator, samples, cancelled, inlierRatio);
+		else
+			result = accumulator.Solve();
 
-	Eigen::Matrix3d i = Eigen::Matrix3d::Identity();
-	if ((svd.matrixU() * svd.matrixV().transpose()).determinant() < 0)
+		finished = !cancelled;
+	}
+
+	// Compares the estimate with the one from ConvergenceWindow samples ago.
+	bool HasConverged(const Estimate &latest)
 	{
-		i(2,2) = -1;
+		history.push_back({ processed, latest });
+		while (history.size() > 1 && history[1].first + ConvergenceWindow <= processed)
+			history.pop_front();
+
+		return processed >= MinAdaptiveSamples
+			&& history.front().first + ConvergenceWindow <= processed
+			&& Converged(accumulator, latest, history.front().second);
 	}
 
-	Eigen::Matrix3d rot = svd.matrixV() * i * svd.matrixU().transpose();
-	rot.transposeInPlace();
+	// Fewest samples an adaptive job stops at, however good the estimate looks.
+	static const size_t MinAdaptiveSamples = 30;
+
+	const size_t sampleCount;
+	const bool robust;
+	const bool adaptive;
+	Accumulator accumulator;
+	std::vector<Sample> samples;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<Sample> pending;
+	std::atomic<bool> cancelled = { false };
+	bool complete = false;
 
-	Eigen::Vector3d euler = rot.eulerAngles(2, 1, 0) * 180.0 / EIGEN_PI;
+	Estimate estimate;
+	bool hasEstimate = false;
+
+	Estimate result;
+	double inlierRatio = 1.0;
+
+	// Estimates of the last ConvergenceWindow samples, with the sample count each was made at.
+	std::deque<std::pair<size_t, Estimate>> history;
+
+	std::atomic<size_t> processed = { 0 };
+	std::atomic<bool> stoppedEarly = { false };
+	std::atomic<bool> finished = { false };
+
+	std::thread thread;
+};
+
+Eigen::Vector3d CalibrateRotation(const SolveJob<RotationAccumulator> &job)
+{
+	auto &accumulator = job.Get();
+
+	char buf[256];
+	snprintf(buf, sizeof buf, "Got %zd samples with %zd delta samples\n", accumulator.samples.size(), accumulator.DeltaCount());
+	CalCtx.Log(buf);
+
+	if (job.Robust())
+	{
+		snprintf(buf, sizeof buf, "Rotation inliers: %.1f%% of delta samples\n", job.InlierRatio() * 100.0);
+		CalCtx.Log(buf);
+	}
+
+	Eigen::Vector3d euler = EulerFromRotation(job.Result());
 
 	snprintf(buf, sizeof buf, "Calibrated rotation: yaw=%.2f pitch=%.2f roll=%.2f\n", euler[1], euler[2], euler[0]);
 	CalCtx.Log(buf);
 	return euler;
 }
 
-Eigen::Vector3d CalibrateTranslation(const std::vector<Sample> &samples)
+Eigen::Vector3d CalibrateTranslation(const SolveJob<TranslationAccumulator> &job)
 {
-	std::vector<std::pair<Eigen::Vector3d, Eigen::Matrix3d>> deltas;
+	auto &accumulator = job.Get();
 
-	for (size_t i = 0; i < samples.size(); i++)
-	{
-		for (size_t j = 0; j < i; j++)
-		{
-			auto QAi = samples[i].ref.rot.transpose();
-			auto QAj = samples[j].ref.rot.transpose();
-			auto dQA = QAj - QAi;
-			auto CA = QAj * (samples[j].ref.trans - samples[j].target.trans) - QAi * (samples[i].ref.trans - samples[i].target.trans);
-			deltas.push_back(std::make_pair(CA, dQA));
-
-			auto QBi = samples[i].target.rot.transpose();
-			auto QBj = samples[j].target.rot.transpose();
-			auto dQB = QBj - QBi;
-			auto CB = QBj * (samples[j].ref.trans - samples[j].target.trans) - QBi * (samples[i].ref.trans - samples[i].target.trans);
-			deltas.push_back(std::make_pair(CB, dQB));
-		}
-	}
-
-	Eigen::VectorXd constants(deltas.size() * 3);
-	Eigen::MatrixXd coefficients(deltas.size() * 3, 3);
+	char buf[256];
+	snprintf(buf, sizeof buf, "Got %zd samples with %zd delta samples\n", accumulator.sampleCount, accumulator.PairCount() * 2);
+	CalCtx.Log(buf);
 
-	for (size_t i = 0; i < deltas.size(); i++)
+	if (job.Robust())
 	{
-		for (int axis = 0; axis < 3; axis++)
-		{
-			constants(i * 3 + axis) = deltas[i].first(axis);
-			coefficients.row(i * 3 + axis) = deltas[i].second.row(axis);
-		}
+		snprintf(buf, sizeof buf, "Translation inliers: %.1f%% of samples\n", job.InlierRatio() * 100.0);
+		CalCtx.Log(buf);
 	}
 
-	Eigen::Vector3d trans = coefficients.bdcSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(constants);
+	Eigen::Vector3d trans = job.Result();
 	auto transcm = trans * 100.0;
 
-	char buf[256];
 	snprintf(buf, sizeof buf, "Calibrated translation x=%.2f y=%.2f z=%.2f\n", transcm[0], transcm[1], transcm[2]);
 	CalCtx.Log(buf);
 	return transcm;
 }
 
-Sample CollectSample(const CalibrationContext &ctx)
+void CalibrateJoint(const SolveJob<JointAccumulator> &job, CalibrationContext &ctx)
 {
-	vr::TrackedDevicePose_t reference, target;
-	reference.bPoseIsValid = false;
-	target.bPoseIsValid = false;
+	auto &accumulator = job.Get().rotation;
 
-	reference = ctx.devicePoses[ctx.referenceID];
-	target = ctx.devicePoses[ctx.targetID];
+	char buf[256];
+	snprintf(buf, sizeof buf, "Got %zd samples with %zd delta samples\n", accumulator.samples.size(), accumulator.DeltaCount());
+	CalCtx.Log(buf);
 
+	if (job.Robust())
+	{
+		snprintf(buf, sizeof buf, "Inliers: %.1f%% of the data\n", job.InlierRatio() * 100.0);
+		CalCtx.Log(buf);
+	}
+
+	auto &euler = ctx.calibratedRotation;
+	euler = EulerFromRotation(job.Result().rot);
+
+	snprintf(buf, sizeof buf, "Calibrated rotation: yaw=%.2f pitch=%.2f roll=%.2f\n", euler[1], euler[2], euler[0]);
+	CalCtx.Log(buf);
+
+	auto &transcm = ctx.calibratedTranslation;
+	transcm = job.Result().trans * 100.0;
+
+	snprintf(buf, sizeof buf, "Calibrated translation x=%.2f y=%.2f z=%.2f\n", transcm[0], transcm[1], transcm[2]);
+	CalCtx.Log(buf);
+}
+
+Sample CollectSample(const PoseSampler::PosePair &pair)
+{
 	bool ok = true;
-	if (!reference.bPoseIsValid)
+	if (!pair.reference.bPoseIsValid)
 	{
 		CalCtx.Log("Reference device is not tracking\n"); ok = false;
 	}
-	if (!target.bPoseIsValid)
+	if (!pair.target.bPoseIsValid)
 	{
 		CalCtx.Log("Target device is not tracking\n"); ok = false;
 	}
@@ -228,19 +313,24 @@ Sample CollectSample(const CalibrationContext &ctx)
 	}
 
 	return Sample(
-		Pose(reference.mDeviceToAbsoluteTracking),
-		Pose(target.mDeviceToAbsoluteTracking)
+		Pose(pair.reference.mDeviceToAbsoluteTracking.m),
+		Pose(pair.target.mDeviceToAbsoluteTracking.m)
 	);
 }
 
-vr::HmdQuaternion_t VRRotationQuat(Eigen::Vector3d eulerdeg)
+static Eigen::Quaterniond QuatFromEuler(const Eigen::Vector3d &eulerdeg)
 {
 	auto euler = eulerdeg * EIGEN_PI / 180.0;
 
-	Eigen::Quaterniond rotQuat =
+	return
 		Eigen::AngleAxisd(euler(0), Eigen::Vector3d::UnitZ()) *
 		Eigen::AngleAxisd(euler(1), Eigen::Vector3d::UnitY()) *
 		Eigen::AngleAxisd(euler(2), Eigen::Vector3d::UnitX());
+}
+
+vr::HmdQuaternion_t VRRotationQuat(Eigen::Vector3d eulerdeg)
+{
+	Eigen::Quaterniond rotQuat = QuatFromEuler(eulerdeg);
 
 	vr::HmdQuaternion_t vrRotQuat;
 	vrRotQuat.x = rotQuat.coeffs()[0];
@@ -260,7 +350,7 @@ vr::HmdVector3d_t VRTranslationVec(Eigen::Vector3d transcm)
 	return vrTrans;
 }
 
-void ResetAndDisableOffsets(uint32_t id)
+protocol::SetDeviceTransform ResetTransform(uint32_t id)
 {
 	vr::HmdVector3d_t zeroV;
 	zeroV.v[0] = zeroV.v[1] = zeroV.v[2] = 0;
@@ -268,21 +358,93 @@ void ResetAndDisableOffsets(uint32_t id)
 	vr::HmdQuaternion_t zeroQ;
 	zeroQ.x = 0; zeroQ.y = 0; zeroQ.z = 0; zeroQ.w = 1;
 
-	protocol::Request req(protocol::RequestSetDeviceTransform);
-	req.setDeviceTransform = { id, false, zeroV, zeroQ, 1.0 };
-	Driver.SendBlocking(req);
+	return { id, false, zeroV, zeroQ, 1.0 };
+}
+
+// What the driver last acknowledged for each device. Profile scans only send the devices whose
+// transform differs from it, so applying an unchanged profile costs no IPC at all.
+struct AppliedTransform
+{
+	bool known = false;
+	bool enabled;
+	vr::HmdVector3d_t translation;
+	vr::HmdQuaternion_t rotation;
+	double scale;
+};
+
+static AppliedTransform Applied[vr::k_unMaxTrackedDeviceCount];
+
+static bool IsApplied(const protocol::SetDeviceTransform &transform)
+{
+	auto &applied = Applied[transform.openVRID];
+	return applied.known
+		&& applied.enabled == transform.enabled
+		&& memcmp(&applied.translation, &transform.translation, sizeof applied.translation) == 0
+		&& memcmp(&applied.rotation, &transform.rotation, sizeof applied.rotation) == 0
+		&& applied.scale == transform.scale;
+}
+
+// For transforms that set everything. After a partial update, use ForgetApplied instead.
+static void SetApplied(const protocol::SetDeviceTransform &transform)
+{
+	auto &applied = Applied[transform.openVRID];
+	applied.known = true;
+	applied.enabled = transform.enabled;
+	applied.translation = transform.translation;
+	applied.rotation = transform.rotation;
+	applied.scale = transform.scale;
+}
+
+static void ForgetApplied(uint32_t id)
+{
+	Applied[id].known = false;
+}
+
+// Transforms are marked applied as they are sent, so scans don't send them again while they are in
+// flight, and forgotten if the driver turns them down.
+static void SendTransforms(const protocol::SetDeviceTransform *transforms, uint32_t count)
+{
+	std::vector<uint32_t> ids;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		SetApplied(transforms[i]);
+		ids.push_back(transforms[i].openVRID);
+	}
+
+	Driver.SetDeviceTransforms(transforms, count, [ids](const protocol::Response &response) {
+		if (response.type != protocol::ResponseSuccess)
+		{
+			for (auto id : ids)
+				ForgetApplied(id);
+		}
+	});
+}
+
+void ResetAndDisableOffsets(uint32_t id)
+{
+	auto transform = ResetTransform(id);
+	SendTransforms(&transform, 1);
 }
 
 static_assert(vr::k_unTrackedDeviceIndex_Hmd == 0, "HMD index expected to be 0");
 
 void ScanAndApplyProfile(CalibrationContext &ctx)
 {
-	char buffer[vr::k_unMaxPropertyStringSize];
 	ctx.enabled = ctx.validProfile;
 
+	// Every device that needs a change is handed to the driver at once.
+	protocol::SetDeviceTransform changed[vr::k_unMaxTrackedDeviceCount];
+	uint32_t changedCount = 0;
+
+	auto apply = [&](const protocol::SetDeviceTransform &transform) {
+		if (!IsApplied(transform))
+			changed[changedCount++] = transform;
+	};
+
 	for (uint32_t id = 0; id < vr::k_unMaxTrackedDeviceCount; ++id)
 	{
-		auto deviceClass = vr::VRSystem()->GetTrackedDeviceClass(id);
+		auto &device = Devices.Device(id);
+		auto deviceClass = device.deviceClass;
 		if (deviceClass == vr::TrackedDeviceClass_Invalid)
 			continue;
 
@@ -297,20 +459,17 @@ void ScanAndApplyProfile(CalibrationContext &ctx)
 
 		if (!ctx.enabled)
 		{
-			ResetAndDisableOffsets(id);
+			apply(ResetTransform(id));
 			continue;
 		}
 
-		vr::ETrackedPropertyError err = vr::TrackedProp_Success;
-		vr::VRSystem()->GetStringTrackedDeviceProperty(id, vr::Prop_TrackingSystemName_String, buffer, vr::k_unMaxPropertyStringSize, &err);
-
-		if (err != vr::TrackedProp_Success)
+		if (!device.hasTrackingSystem)
 		{
-			ResetAndDisableOffsets(id);
+			apply(ResetTransform(id));
 			continue;
 		}
 
-		std::string trackingSystem(buffer);
+		auto &trackingSystem = device.trackingSystem;
 
 		if (id == vr::k_unTrackedDeviceIndex_Hmd)
 		{
@@ -323,27 +482,28 @@ void ScanAndApplyProfile(CalibrationContext &ctx)
 				ctx.enabled = false;
 			}
 
-			ResetAndDisableOffsets(id);
+			apply(ResetTransform(id));
 			continue;
 		}
 
 		if (trackingSystem != ctx.targetTrackingSystem)
 		{
-			ResetAndDisableOffsets(id);
+			apply(ResetTransform(id));
 			continue;
 		}
 
-		protocol::Request req(protocol::RequestSetDeviceTransform);
-		req.setDeviceTransform = {
+		apply({
 			id,
 			true,
 			VRTranslationVec(ctx.calibratedTranslation),
 			VRRotationQuat(ctx.calibratedRotation),
 			ctx.calibratedScale
-		};
-		Driver.SendBlocking(req);
+		});
 	}
 
+	if (changedCount > 0)
+		SendTransforms(changed, changedCount);
+
 	if (ctx.enabled && ctx.chaperone.valid && ctx.chaperone.autoApply)
 	{
 		uint32_t quadCount = 0;
@@ -358,18 +518,302 @@ void ScanAndApplyProfile(CalibrationContext &ctx)
 	}
 }
 
+static std::unique_ptr<SolveJob<RotationAccumulator>> rotationJob;
+static std::unique_ptr<SolveJob<TranslationAccumulator>> translationJob;
+static std::unique_ptr<SolveJob<JointAccumulator>> jointJob;
+static size_t samplesCollected = 0;
+
+static PoseSampler Sampler;
+static TraceRecorder Recorder;
+static SampleSelector Selector;
+static size_t samplesSeen = 0;
+static bool coverageSaturated = false;
+static double lastValidPoseTime = 0.0;
+
+// How long either device may stop tracking before the calibration is aborted.
+static const double TrackingLossTimeout = 0.2;
+
+// Transforms sent for the calibration target that the driver hasn't answered yet. Samples are held
+// back until it has, and whatever was sampled before then is dropped.
+static size_t targetTransformsPending = 0;
+
+// The transform sent for the calibration target, which the sampler applies to captured poses.
+static protocol::DeviceTransform targetTransform;
+
+static TracePhase PhaseOf(CalibrationState state)
+{
+	return state == CalibrationState::Rotation ? TracePhase::Rotation
+		: state == CalibrationState::Translation ? TracePhase::Translation : TracePhase::Joint;
+}
+
+static void SendTargetTransform(const protocol::SetDeviceTransform &transform)
+{
+	ForgetApplied(transform.openVRID);
+
+	protocol::ApplyTransformUpdate(targetTransform, transform);
+	Sampler.SetTargetTransform(targetTransform);
+
+	targetTransformsPending++;
+	Recorder.SetPhase(TracePhase::Transition);
+	Driver.SetDeviceTransforms(&transform, 1, [](const protocol::Response &) {
+		targetTransformsPending--;
+		Sampler.Discard();
+		if (targetTransformsPending == 0)
+			Recorder.SetPhase(PhaseOf(CalCtx.state));
+	});
+}
+
+static void ResetSolveJobs(CalibrationContext &ctx)
+{
+	rotationJob.reset();
+	translationJob.reset();
+	jointJob.reset();
+	samplesCollected = 0;
+	samplesSeen = 0;
+	coverageSaturated = false;
+	Selector.Clear();
+	ctx.estimateValid = false;
+}
+
+static void StartRecording(CalibrationContext &ctx, const char *referenceSerial, const char *targetSerial)
+{
+	auto nowTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	tm now;
+	localtime_s(&now, &nowTime);
+
+	char name[64];
+	strftime(name, sizeof name, "space_calibrator_%Y%m%d_%H%M%S.trace", &now);
+	std::string path = DataDirectory() + name;
+
+	TraceHeader header;
+	header.referenceSerial = referenceSerial;
+	header.referenceTrackingSystem = ctx.referenceTrackingSystem;
+	header.targetSerial = targetSerial;
+	header.targetTrackingSystem = ctx.targetTrackingSystem;
+
+	char buf[512];
+	if (Recorder.Start(path, header))
+		snprintf(buf, sizeof buf, "Recording pose trace to %s\n", path.c_str());
+	else
+		snprintf(buf, sizeof buf, "Could not create pose trace file %s\n", path.c_str());
+	CalCtx.Log(buf);
+	Recorder.SetPhase(targetTransformsPending > 0 ? TracePhase::Transition : PhaseOf(ctx.state));
+}
+
+// Stops sampling, and with it any trace recording of the session.
+static void StopSampling()
+{
+	Sampler.Stop();
+	if (!Recorder.Recording())
+		return;
+
+	Recorder.Stop();
+	if (Recorder.Dropped() > 0)
+	{
+		char buf[256];
+		snprintf(buf, sizeof buf, "Pose trace is missing %zd pose pairs\n", Recorder.Dropped());
+		CalCtx.Log(buf);
+	}
+}
+
+template<class Accumulator>
+static void LogSelection(const SolveJob<Accumulator> &job)
+{
+	char buf[256];
+	snprintf(buf, sizeof buf, "Selected %zd of %zd samples\n", samplesCollected, samplesSeen);
+	CalCtx.Log(buf);
+
+	if (job.StoppedEarly())
+	{
+		snprintf(buf, sizeof buf, "Converged after %zd of up to %zd samples\n", job.Progress(), CalCtx.SampleCount());
+		CalCtx.Log(buf);
+	}
+	else if (coverageSaturated)
+	{
+		snprintf(buf, sizeof buf, "Orientation coverage saturated after %zd of up to %zd samples\n", samplesCollected, CalCtx.SampleCount());
+		CalCtx.Log(buf);
+	}
+}
+
+// Continuous calibration keeps a ContinuousAccumulator fed from its own, slower pose sampling
+// while no calibration is running, and moves the profile to its estimate whenever the two drift
+// apart by more than a threshold.
+static ContinuousAccumulator continuousAccumulator(0.99, 32);
+static bool continuousSampling = false;
+static bool continuousCapture = false;
+static uint32_t continuousReferenceID, continuousTargetID;
+static double continuousWindowStart = 0.0, continuousSpent = 0.0, continuousLastPush = 0.0;
+static double continuousSamplerBusy = 0.0;
+
+// Time it may spend per second sampling poses, folding them in and solving. Pose pairs beyond it
+// are dropped, which the forgetting accumulator takes in stride.
+static const double ContinuousBudget = 0.002;
+
+static const double ContinuousSamplerRate = 60.0;
+
+// How far the estimate may be from the profile before the profile is moved, in degrees and cm,
+// and how many effective samples it must rest on.
+static const double ContinuousPushAngle = 0.25;
+static const double ContinuousPushDistance = 0.3;
+static const double ContinuousMinWeight = 30.0;
+static const double ContinuousMinPushInterval = 2.0;
+
+static void StopContinuous()
+{
+	CalCtx.continuous.active = false;
+	if (!continuousSampling)
+		return;
+
+	Sampler.Stop();
+	continuousSampling = false;
+}
+
+// The target's pose without the profile the driver applies to it, assuming unit scale.
+static Pose RemoveProfile(const Pose &pose, const CalibrationContext &ctx)
+{
+	Eigen::Matrix3d rot = QuatFromEuler(ctx.calibratedRotation).toRotationMatrix();
+	Eigen::Vector3d trans = ctx.calibratedTranslation * 0.01;
+
+	Pose raw;
+	raw.rot = rot.transpose() * pose.rot;
+	raw.trans = rot.transpose() * (pose.trans - trans);
+	return raw;
+}
+
+static void ContinuousCalibrationTick(CalibrationContext &ctx, double time)
+{
+	auto capture = ctx.driverPoseCapture ? Driver.PoseCapture() : nullptr;
+
+	// Polled poses have the profile applied, and only a profile without scale can be taken back
+	// out of them. Captured poses are taken before the driver applies it.
+	bool wanted = ctx.continuousCalibration && ctx.enabled
+		&& ctx.referenceID < vr::k_unMaxTrackedDeviceCount && ctx.targetID < vr::k_unMaxTrackedDeviceCount
+		&& (capture || ctx.calibratedScale == 1.0);
+
+	if (!wanted)
+	{
+		StopContinuous();
+		return;
+	}
+
+	if (!continuousSampling || ctx.referenceID != continuousReferenceID || ctx.targetID != continuousTargetID)
+	{
+		continuousAccumulator.Clear();
+		continuousReferenceID = ctx.referenceID;
+		continuousTargetID = ctx.targetID;
+		continuousCapture = capture != nullptr;
+		continuousWindowStart = time;
+		continuousSpent = 0.0;
+		continuousSamplerBusy = 0.0;
+		ctx.continuous = CalibrationContext::Continuous();
+
+		Sampler.Start(ctx.referenceID, ctx.targetID, ContinuousSamplerRate, capture);
+		continuousSampling = true;
+	}
+
+	ctx.continuous.active = true;
+	ctx.wantedUpdateInterval = 0.1;
+
+	// Time the sampler thread spent since the last tick counts against the budget as well.
+	double samplerBusy = Sampler.BusyTime();
+	continuousSpent += samplerBusy - continuousSamplerBusy;
+	continuousSamplerBusy = samplerBusy;
+
+	if (time - continuousWindowStart >= 1.0)
+	{
+		ctx.continuous.cost = continuousSpent / (time - continuousWindowStart);
+		continuousWindowStart = time;
+		continuousSpent = 0.0;
+	}
+
+	double start = PoseSampler::Now();
+
+	PoseSampler::PosePair pair;
+	while (Sampler.Pop(pair))
+	{
+		if (continuousSpent + (PoseSampler::Now() - start) >= ContinuousBudget)
+		{
+			ctx.continuous.overBudget++;
+			continue;
+		}
+
+		if (!pair.reference.bPoseIsValid || !pair.target.bPoseIsValid)
+			continue;
+
+		Sample sample(Pose(pair.reference.mDeviceToAbsoluteTracking.m), Pose(pair.target.mDeviceToAbsoluteTracking.m));
+		if (!continuousCapture)
+			sample.target = RemoveProfile(sample.target, ctx);
+
+		continuousAccumulator.AddSample(sample);
+	}
+
+	ctx.continuous.weight = continuousAccumulator.Weight();
+
+	if (continuousAccumulator.CanSolve() && continuousAccumulator.Weight() >= ContinuousMinWeight && time - continuousLastPush >= ContinuousMinPushInterval)
+	{
+		auto estimate = continuousAccumulator.Solve();
+		Eigen::Matrix3d current = QuatFromEuler(ctx.calibratedRotation).toRotationMatrix();
+
+		double angle = Eigen::AngleAxisd(estimate.rot * current.transpose()).angle() * 180.0 / EIGEN_PI;
+		double distance = (estimate.trans * 100.0 - ctx.calibratedTranslation).norm();
+
+		if (angle > ContinuousPushAngle || distance > ContinuousPushDistance)
+		{
+			ctx.calibratedRotation = EulerFromRotation(estimate.rot);
+			ctx.calibratedTranslation = estimate.trans * 100.0;
+			ScanAndApplyProfile(ctx);
+			SaveProfile(ctx);
+
+			// Polled pairs already queued have the old profile in them.
+			Sampler.Discard();
+
+			ctx.continuous.updates++;
+			continuousLastPush = time;
+		}
+	}
+
+	continuousSpent += PoseSampler::Now() - start;
+}
+
 void StartCalibration()
 {
+	StopContinuous();
 	CalCtx.state = CalibrationState::Begin;
 	CalCtx.wantedUpdateInterval = 0.0;
 	CalCtx.messages.clear();
 }
 
+// Asks the driver for the target's pose hook counters, and turns them into rates since the last
+// answer once it arrives.
+static void RequestPoseHookStats(CalibrationContext &ctx, double time)
+{
+	static protocol::PoseHookStats previous = {};
+	static uint32_t previousID = vr::k_unTrackedDeviceIndexInvalid;
+	static double previousTime = 0.0;
+
+	uint32_t id = ctx.targetID;
+	Driver.GetPoseHookStats(id, [&ctx, id, time](const protocol::PoseHookStats &stats) {
+		uint64_t updates = stats.updates - previous.updates;
+		ctx.poseHook.valid = id == previousID && stats.updates > previous.updates && time > previousTime;
+		if (ctx.poseHook.valid)
+		{
+			ctx.poseHook.updatesPerSecond = updates / (time - previousTime);
+			ctx.poseHook.meanMicroseconds = (stats.totalNanoseconds - previous.totalNanoseconds) / 1000.0 / updates;
+		}
+
+		previous = stats;
+		previousID = id;
+		previousTime = time;
+	});
+}
+
 void CalibrationTick(double time)
 {
 	if (!vr::VRSystem())
 		return;
 
+	Driver.Poll();
+
 	auto &ctx = CalCtx;
 	if ((time - ctx.timeLastTick) < 0.05)
 		return;
@@ -377,18 +821,26 @@ void CalibrationTick(double time)
 	ctx.timeLastTick = time;
 	vr::VRSystem()->GetDeviceToAbsoluteTrackingPose(vr::TrackingUniverseRawAndUncalibrated, 0.0f, ctx.devicePoses, vr::k_unMaxTrackedDeviceCount);
 
+	// New devices get their offsets right away instead of on the next timed scan.
+	bool devicesChanged = Devices.Update(time);
+
 	if (ctx.state == CalibrationState::None)
 	{
 		ctx.wantedUpdateInterval = 1.0;
 
-		if ((time - ctx.timeLastScan) >= 1.0)
+		if (devicesChanged || (time - ctx.timeLastScan) >= 1.0)
 		{
 			ScanAndApplyProfile(ctx);
+			RequestPoseHookStats(ctx, time);
 			ctx.timeLastScan = time;
 		}
+
+		ContinuousCalibrationTick(ctx, time);
 		return;
 	}
 
+	StopContinuous();
+
 	if (ctx.state == CalibrationState::Editing)
 	{
 		ctx.wantedUpdateInterval = 0.1;
@@ -440,58 +892,157 @@ void CalibrationTick(double time)
 			return;
 		}
 
-		ResetAndDisableOffsets(ctx.targetID);
-		ctx.state = CalibrationState::Rotation;
+		SendTargetTransform(ResetTransform(ctx.targetID));
+		ResetSolveJobs(ctx);
+
+		if (ctx.calibrationMode == CalibrationContext::JOINT)
+		{
+			jointJob.reset(new SolveJob<JointAccumulator>(CalCtx.SampleCount(), ctx.robustSolve, ctx.adaptiveSampleCount));
+			ctx.state = CalibrationState::Joint;
+		}
+		else
+		{
+			rotationJob.reset(new SolveJob<RotationAccumulator>(CalCtx.SampleCount(), ctx.robustSolve, ctx.adaptiveSampleCount));
+			ctx.state = CalibrationState::Rotation;
+		}
+
+		if (ctx.recordTrace)
+			StartRecording(ctx, referenceSerial, targetSerial);
+
+		auto capture = ctx.driverPoseCapture ? Driver.PoseCapture() : nullptr;
+		if (ctx.driverPoseCapture && !capture)
+			CalCtx.Log("Driver pose capture is unavailable, polling poses instead\n");
+
+		Sampler.Start(ctx.referenceID, ctx.targetID, ctx.samplerRate, capture, Recorder.Recording() ? &Recorder : nullptr);
+		lastValidPoseTime = PoseSampler::Now();
 		ctx.wantedUpdateInterval = 0.0;
 
 		CalCtx.Log("Starting calibration...\n");
 		return;
 	}
 
-	auto sample = CollectSample(ctx);
-	if (!sample.valid)
-	{
+	if (targetTransformsPending > 0)
 		return;
+
+	PoseSampler::PosePair pair;
+	while (samplesCollected < CalCtx.SampleCount() && !coverageSaturated && Sampler.Pop(pair))
+	{
+		if (pair.reference.bPoseIsValid && pair.target.bPoseIsValid)
+			lastValidPoseTime = pair.time;
+		else if (pair.time - lastValidPoseTime < TrackingLossTimeout)
+			continue; // Skip over brief tracking dropouts.
+
+		auto sample = CollectSample(pair);
+		if (!sample.valid)
+		{
+			StopSampling();
+			ResetSolveJobs(ctx);
+			return;
+		}
+
+		samplesSeen++;
+		if (Selector.Accept(sample, pair.time))
+		{
+			if (ctx.state == CalibrationState::Rotation)
+				rotationJob->AddSample(sample);
+			else if (ctx.state == CalibrationState::Translation)
+				translationJob->AddSample(sample);
+			else
+				jointJob->AddSample(sample);
+
+			samplesCollected++;
+		}
+
+		// Further samples would mostly repeat orientations the phase already has.
+		if (Selector.Saturated(pair.time))
+		{
+			coverageSaturated = true;
+			if (ctx.state == CalibrationState::Rotation)
+				rotationJob->Finish();
+			else if (ctx.state == CalibrationState::Translation)
+				translationJob->Finish();
+			else
+				jointJob->Finish();
+		}
 	}
 
-	static std::vector<Sample> samples;
-	samples.push_back(sample);
+	if (ctx.state == CalibrationState::Rotation)
+	{
+		Eigen::Matrix3d estimate;
+		if (rotationJob->LatestEstimate(estimate))
+		{
+			ctx.estimatedRotation = EulerFromRotation(estimate);
+			ctx.estimateValid = true;
+		}
+
+		CalCtx.Progress(rotationJob->Progress(), CalCtx.SampleCount());
+		if (!rotationJob->Ready())
+			return;
 
-	CalCtx.Progress(samples.size(), CalCtx.SampleCount());
+		CalCtx.Log("\n");
+		LogSelection(*rotationJob);
+		ctx.calibratedRotation = CalibrateRotation(*rotationJob);
 
-	if (samples.size() == CalCtx.SampleCount())
+		auto vrRotQuat = VRRotationQuat(ctx.calibratedRotation);
+
+		ResetSolveJobs(ctx);
+		translationJob.reset(new SolveJob<TranslationAccumulator>(CalCtx.SampleCount(), ctx.robustSolve, ctx.adaptiveSampleCount));
+		ctx.state = CalibrationState::Translation;
+
+		// After the state change, since the transform may be applied before this returns.
+		SendTargetTransform({ ctx.targetID, true, vrRotQuat });
+	}
+	else if (ctx.state == CalibrationState::Translation)
 	{
+		CalCtx.Progress(translationJob->Progress(), CalCtx.SampleCount());
+		if (!translationJob->Ready())
+			return;
+
 		CalCtx.Log("\n");
-		if (ctx.state == CalibrationState::Rotation)
-		{
-			ctx.calibratedRotation = CalibrateRotation(samples);
+		LogSelection(*translationJob);
+		ctx.calibratedTranslation = CalibrateTranslation(*translationJob);
 
-			auto vrRotQuat = VRRotationQuat(ctx.calibratedRotation);
+		auto vrTrans = VRTranslationVec(ctx.calibratedTranslation);
 
-			protocol::Request req(protocol::RequestSetDeviceTransform);
-			req.setDeviceTransform = { ctx.targetID, true, vrRotQuat };
-			Driver.SendBlocking(req);
+		SendTargetTransform({ ctx.targetID, true, vrTrans });
 
-			ctx.state = CalibrationState::Translation;
-		}
-		else if (ctx.state == CalibrationState::Translation)
+		ctx.validProfile = true;
+		SaveProfile(ctx);
+		CalCtx.Log("Finished calibration, profile saved\n");
+
+		StopSampling();
+		ResetSolveJobs(ctx);
+		ctx.state = CalibrationState::None;
+	}
+	else if (ctx.state == CalibrationState::Joint)
+	{
+		JointEstimate estimate;
+		if (jointJob->LatestEstimate(estimate))
 		{
-			ctx.calibratedTranslation = CalibrateTranslation(samples);
+			ctx.estimatedRotation = EulerFromRotation(estimate.rot);
+			ctx.estimateValid = true;
+		}
+
+		CalCtx.Progress(jointJob->Progress(), CalCtx.SampleCount());
+		if (!jointJob->Ready())
+			return;
 
-			auto vrTrans = VRTranslationVec(ctx.calibratedTranslation);
+		CalCtx.Log("\n");
+		LogSelection(*jointJob);
+		CalibrateJoint(*jointJob, ctx);
 
-			protocol::Request req(protocol::RequestSetDeviceTransform);
-			req.setDeviceTransform = { ctx.targetID, true, vrTrans };
-			Driver.SendBlocking(req);
+		auto vrRotQuat = VRRotationQuat(ctx.calibratedRotation);
+		auto vrTrans = VRTranslationVec(ctx.calibratedTranslation);
 
-			ctx.validProfile = true;
-			SaveProfile(ctx);
-			CalCtx.Log("Finished calibration, profile saved\n");
+		SendTargetTransform({ ctx.targetID, true, vrTrans, vrRotQuat });
 
-			ctx.state = CalibrationState::None;
-		}
+		ctx.validProfile = true;
+		SaveProfile(ctx);
+		CalCtx.Log("Finished calibration, profile saved\n");
 
-		samples.clear();
+		StopSampling();
+		ResetSolveJobs(ctx);
+		ctx.state = CalibrationState::None;
 	}
 }
 
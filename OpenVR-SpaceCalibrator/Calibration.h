@@ -10,6 +10,7 @@ enum class CalibrationState
 	Begin,
 	Rotation,
 	Translation,
+	Joint,
 	Editing,
 };
 
@@ -22,6 +23,10 @@ struct CalibrationContext
 	Eigen::Vector3d calibratedTranslation;
 	double calibratedScale;
 
+	// Converging rotation estimate while samples are still being collected.
+	Eigen::Vector3d estimatedRotation;
+	bool estimateValid = false;
+
 	std::string referenceTrackingSystem;
 	std::string targetTrackingSystem;
 
@@ -38,6 +43,52 @@ struct CalibrationContext
 	};
 	Speed calibrationSpeed = FAST;
 
+	enum Mode
+	{
+		SEQUENTIAL = 0, // Rotation phase, then a translation phase with the rotation applied.
+		JOINT = 1 // Rotation and translation from a single set of samples.
+	};
+	Mode calibrationMode = SEQUENTIAL;
+
+	// Rate at which device poses are polled during calibration, within [MinSamplerRate, MaxSamplerRate].
+	double samplerRate = 250.0;
+	static constexpr double MinSamplerRate = 10.0, MaxSamplerRate = 1000.0;
+
+	// Take the raw poses the driver captures at the devices' own rate, instead of polling.
+	bool driverPoseCapture = false;
+
+	// Keep refining the profile from the selected devices while they stay attached to each other,
+	// following drift between the tracking systems.
+	bool continuousCalibration = false;
+
+	struct Continuous
+	{
+		bool active = false;
+		double weight = 0; // Effective number of samples behind the estimate.
+		double cost = 0; // Seconds spent per second sampling and solving, over the last second.
+		size_t updates = 0; // Profile changes pushed since it started.
+		size_t overBudget = 0; // Pose pairs dropped for lack of time.
+	} continuous;
+
+	// The driver's pose hook on the target device over the last second, for troubleshooting.
+	struct PoseHook
+	{
+		bool valid = false;
+		double updatesPerSecond = 0;
+		double meanMicroseconds = 0; // Per update, including SteamVR's own handling.
+	} poseHook;
+
+	// Fit with RANSAC and Huber reweighting instead of plain least squares, so that tracking
+	// glitches during sampling don't pull the result off.
+	bool robustSolve = false;
+
+	// End each phase once the estimate has converged, with SampleCount() as the most it will take.
+	// Opt in, so existing profiles keep taking the fixed count they were tuned for.
+	bool adaptiveSampleCount = false;
+
+	// Stream the sampled pose pairs of each calibration to a trace file for offline replay.
+	bool recordTrace = false;
+
 	vr::TrackedDevicePose_t devicePoses[vr::k_unMaxTrackedDeviceCount];
 
 	struct Chaperone
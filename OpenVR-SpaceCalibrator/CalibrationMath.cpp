@@ -0,0 +1,611 @@
+#include "CalibrationMath.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+Eigen::Vector3d AxisFromRotationMatrix3(Eigen::Matrix3d rot)
+{
+	return Eigen::Vector3d(rot(2,1) - rot(1,2), rot(0,2) - rot(2,0), rot(1,0) - rot(0,1));
+}
+
+double AngleFromRotationMatrix3(Eigen::Matrix3d rot)
+{
+	return acos((rot(0,0) + rot(1,1) + rot(2,2) - 1.0) / 2.0);
+}
+
+DSample DeltaRotationSamples(Sample s1, Sample s2)
+{
+	// Difference in rotation between samples.
+	auto dref = s1.ref.rot * s2.ref.rot.transpose();
+	auto dtarget = s1.target.rot * s2.target.rot.transpose();
+
+	// When stuck together, the two tracked objects rotate as a pair,
+	// therefore their axes of rotation must be equal between any given pair of samples.
+	DSample ds;
+	ds.ref = AxisFromRotationMatrix3(dref);
+	ds.target = AxisFromRotationMatrix3(dtarget);
+
+	// Reject samples that were too close to each other.
+	auto refA = AngleFromRotationMatrix3(dref);
+	auto targetA = AngleFromRotationMatrix3(dtarget);
+	ds.valid = refA > 0.4 && targetA > 0.4 && ds.ref.norm() > 0.01 && ds.target.norm() > 0.01;
+
+	ds.ref.normalize();
+	ds.target.normalize();
+	return ds;
+}
+
+static std::unique_ptr<ThreadPool> &WorkerPool()
+{
+	static std::unique_ptr<ThreadPool> pool(new ThreadPool());
+	return pool;
+}
+
+static ThreadPool &Workers()
+{
+	return *WorkerPool();
+}
+
+void SetSolverThreadCount(unsigned threadCount)
+{
+	WorkerPool().reset(new ThreadPool(threadCount));
+}
+
+Eigen::Matrix3d KabschRotation(const Eigen::Matrix3d &crossCV)
+{
+	Eigen::JacobiSVD<Eigen::Matrix3d> svd(crossCV, Eigen::ComputeFullU | Eigen::ComputeFullV);
+
+	Eigen::Matrix3d i = Eigen::Matrix3d::Identity();
+	if ((svd.matrixU() * svd.matrixV().transpose()).determinant() < 0)
+	{
+		i(2,2) = -1;
+	}
+
+	Eigen::Matrix3d rot = svd.matrixV() * i * svd.matrixU().transpose();
+	return rot.transpose();
+}
+
+void RotationAccumulator::AddSamples(const Sample *newSamples, size_t count)
+{
+	struct Tile
+	{
+		size_t sample, begin, end;
+		RotationSums sums;
+	};
+
+	std::vector<Tile> tiles;
+	size_t first = samples.size();
+	samples.insert(samples.end(), newSamples, newSamples + count);
+
+	for (size_t i = first; i < samples.size(); i++)
+	{
+		for (size_t begin = 0; begin < i; begin += TileSize)
+			tiles.push_back({ i, begin, std::min<size_t>(begin + TileSize, i), RotationSums() });
+	}
+
+	Workers().ParallelFor(tiles.size(), [&](size_t index) {
+		auto &tile = tiles[index];
+		for (size_t j = tile.begin; j < tile.end; j++)
+		{
+			auto delta = DeltaRotationSamples(samples[tile.sample], samples[j]);
+			if (delta.valid)
+				tile.sums.Add(delta);
+		}
+	});
+
+	for (auto &tile : tiles)
+		sums.Add(tile.sums);
+}
+
+Eigen::Vector3d EulerFromRotation(const Eigen::Matrix3d &rot)
+{
+	return rot.eulerAngles(2, 1, 0) * 180.0 / EIGEN_PI;
+}
+
+Eigen::Vector3d SolveNormalEquations(const Eigen::Matrix3d &AtA, const Eigen::Vector3d &Atb)
+{
+	Eigen::LDLT<Eigen::Matrix3d> ldlt(AtA);
+	if (ldlt.info() == Eigen::Success && ldlt.isPositive() && ldlt.rcond() > 1e-9)
+		return ldlt.solve(Atb);
+
+	// The system is close to singular, e.g. the devices were only rotated about one axis.
+	// Fall back to the minimum norm solution, like the dense SVD solve would give.
+	return AtA.jacobiSvd(Eigen::ComputeFullU | Eigen::ComputeFullV).solve(Atb);
+}
+
+static const int RansacIterations = 256;
+static const int RefineIterations = 10;
+
+// Hypotheses are scored on a fixed random subset of the rotation deltas, the refinement uses all.
+static const size_t RansacScoreDeltas = 4096;
+
+// Distance between a reference axis and the rotated target axis of an inlier delta, ~6 degrees.
+static const double RotationInlierThreshold = 0.1;
+
+// Disagreement of an inlier sample with the common device offset, in meters.
+static const double TranslationInlierThreshold = 0.01;
+
+static double HuberWeight(double residual, double threshold)
+{
+	return residual <= threshold ? 1.0 : threshold / residual;
+}
+
+// Every valid rotation delta between pairs of samples, in pair order.
+static std::vector<DSample> CollectDeltas(const std::vector<Sample> &samples)
+{
+	std::vector<std::vector<DSample>> rows(samples.size());
+
+	Workers().ParallelFor(samples.size(), [&](size_t i) {
+		for (size_t j = 0; j < i; j++)
+		{
+			auto delta = DeltaRotationSamples(samples[i], samples[j]);
+			if (delta.valid)
+				rows[i].push_back(delta);
+		}
+	});
+
+	std::vector<DSample> deltas;
+	for (auto &row : rows)
+		deltas.insert(deltas.end(), row.begin(), row.end());
+	return deltas;
+}
+
+// The deltas are unit axes about a common origin, so unlike the least squares solve the weighted
+// fit needs no centering, and two non-parallel deltas are enough to pin down a rotation.
+Eigen::Matrix3d SolveRobust(const RotationAccumulator &accumulator, const std::vector<Sample> &samples, const std::atomic<bool> &cancelled, double &inlierRatio)
+{
+	auto deltas = CollectDeltas(samples);
+	if (deltas.size() < 2)
+	{
+		inlierRatio = 1.0;
+		return accumulator.Solve();
+	}
+
+	auto residual = [](const Eigen::Matrix3d &rot, const DSample &delta) {
+		return (delta.ref - rot * delta.target).norm();
+	};
+
+	// Fixed seed, so the same samples always give the same result.
+	std::mt19937 rng(1);
+
+	std::vector<size_t> scored(deltas.size());
+	for (size_t i = 0; i < scored.size(); i++)
+		scored[i] = i;
+
+	if (scored.size() > RansacScoreDeltas)
+	{
+		for (size_t i = 0; i < RansacScoreDeltas; i++)
+			std::swap(scored[i], scored[std::uniform_int_distribution<size_t>(i, scored.size() - 1)(rng)]);
+		scored.resize(RansacScoreDeltas);
+	}
+
+	auto countInliers = [&](const Eigen::Matrix3d &rot) {
+		size_t inliers = 0;
+		for (size_t index : scored)
+		{
+			if (residual(rot, deltas[index]) < RotationInlierThreshold)
+				inliers++;
+		}
+		return inliers;
+	};
+
+	// The least squares fit competes as a hypothesis too, it wins on clean data.
+	Eigen::Matrix3d best = accumulator.Solve();
+	size_t bestInliers = countInliers(best);
+
+	std::uniform_int_distribution<size_t> pick(0, deltas.size() - 1);
+	for (int iteration = 0; iteration < RansacIterations && !cancelled; iteration++)
+	{
+		auto &a = deltas[pick(rng)], &b = deltas[pick(rng)];
+		if (a.ref.cross(b.ref).norm() < 0.1)
+			continue;
+
+		Eigen::Matrix3d rot = KabschRotation(a.ref * a.target.transpose() + b.ref * b.target.transpose());
+		size_t inliers = countInliers(rot);
+		if (inliers > bestInliers)
+		{
+			best = rot;
+			bestInliers = inliers;
+		}
+	}
+
+	Eigen::Matrix3d rot = best;
+	for (int iteration = 0; iteration < RefineIterations && !cancelled; iteration++)
+	{
+		Eigen::Matrix3d crossCV = Eigen::Matrix3d::Zero();
+		for (auto &delta : deltas)
+			crossCV += HuberWeight(residual(rot, delta), RotationInlierThreshold) * delta.ref * delta.target.transpose();
+
+		rot = KabschRotation(crossCV);
+	}
+
+	size_t inliers = 0;
+	for (auto &delta : deltas)
+	{
+		if (residual(rot, delta) < RotationInlierThreshold)
+			inliers++;
+	}
+
+	inlierRatio = deltas.empty() ? 0.0 : (double) inliers / deltas.size();
+	return rot;
+}
+
+// The pairwise translation rows (Qj - Qi) x = cj - ci, with c = Q d, say that e = Q x - c is the
+// same for every sample, once with the reference rotation and once with the target rotation.
+// Fitting x together with that common value of e is the same least squares problem as the
+// pairwise one, but it gives each sample a residual of its own to weigh.
+struct TranslationTerms
+{
+	Eigen::Matrix3d Q[2];
+	Eigen::Vector3d c[2];
+
+	TranslationTerms(const Sample &sample)
+	{
+		Eigen::Vector3d d = sample.ref.trans - sample.target.trans;
+		Q[0] = sample.ref.rot.transpose();
+		Q[1] = sample.target.rot.transpose();
+		c[0] = Q[0] * d;
+		c[1] = Q[1] * d;
+	}
+};
+
+static void WeightedTranslationSystem(const std::vector<TranslationTerms> &terms, const std::vector<double> &weights, Eigen::Matrix3d &AtA, Eigen::Vector3d &Atb)
+{
+	AtA.setZero();
+	Atb.setZero();
+
+	double total = 0.0;
+	for (double weight : weights)
+		total += weight;
+
+	for (int device = 0; device < 2; device++)
+	{
+		Eigen::Matrix3d meanQ = Eigen::Matrix3d::Zero();
+		Eigen::Vector3d meanC = Eigen::Vector3d::Zero();
+		for (size_t k = 0; k < terms.size(); k++)
+		{
+			meanQ += weights[k] * terms[k].Q[device];
+			meanC += weights[k] * terms[k].c[device];
+		}
+		meanQ /= total;
+		meanC /= total;
+
+		for (size_t k = 0; k < terms.size(); k++)
+		{
+			if (weights[k] == 0.0)
+				continue;
+
+			Eigen::Matrix3d q = terms[k].Q[device] - meanQ;
+			AtA += weights[k] * q.transpose() * q;
+			Atb += weights[k] * q.transpose() * (terms[k].c[device] - meanC);
+		}
+	}
+}
+
+static Eigen::Vector3d SolveWeightedTranslation(const std::vector<TranslationTerms> &terms, const std::vector<double> &weights)
+{
+	Eigen::Matrix3d AtA;
+	Eigen::Vector3d Atb;
+	WeightedTranslationSystem(terms, weights, AtA, Atb);
+	return SolveNormalEquations(AtA, Atb);
+}
+
+// Distance of each sample's e from the weighted mean, the worse of the two devices.
+static void TranslationResiduals(const std::vector<TranslationTerms> &terms, const std::vector<double> &weights, const Eigen::Vector3d &x, std::vector<double> &residuals)
+{
+	residuals.assign(terms.size(), 0.0);
+
+	for (int device = 0; device < 2; device++)
+	{
+		double total = 0.0;
+		Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+		for (size_t k = 0; k < terms.size(); k++)
+		{
+			mean += weights[k] * (terms[k].Q[device] * x - terms[k].c[device]);
+			total += weights[k];
+		}
+		mean /= total;
+
+		for (size_t k = 0; k < terms.size(); k++)
+		{
+			double residual = (terms[k].Q[device] * x - terms[k].c[device] - mean).norm();
+			residuals[k] = std::max<double>(residuals[k], residual);
+		}
+	}
+}
+
+// Three samples are the fewest that determine x: each pair of them only constrains x across the
+// axis of the rotation between the two, so it takes two pairs rotated about different axes.
+static const size_t TranslationSubsetSize = 3;
+
+// sin of the smallest angle between the rotation axes of a subset, ~10 degrees.
+static const double TranslationSubsetMinAxisSine = 0.17;
+
+// Bounds on the smallest eigenvalue of a subset's normal matrix, absolute and relative to the
+// largest. A single 10 degree rotation contributes an eigenvalue of 2 - 2 cos 10 = 0.03.
+static const double TranslationSubsetMinEigenvalue = 0.01;
+static const double TranslationSubsetMinConditioning = 0.02;
+
+// Whether the reference rotations from the first sample of the subset to the other two turn about
+// axes far enough apart to pin down x.
+static bool TranslationSubsetUsable(const std::vector<Sample> &samples, const size_t (&subset)[TranslationSubsetSize])
+{
+	Eigen::Vector3d axes[2];
+	for (int i = 0; i < 2; i++)
+	{
+		Eigen::AngleAxisd delta(samples[subset[i + 1]].ref.rot * samples[subset[0]].ref.rot.transpose());
+		axes[i] = delta.axis();
+	}
+
+	return axes[0].cross(axes[1]).norm() >= TranslationSubsetMinAxisSine;
+}
+
+Eigen::Vector3d SolveRobust(const TranslationAccumulator &accumulator, const std::vector<Sample> &samples, const std::atomic<bool> &cancelled, double &inlierRatio)
+{
+	std::vector<TranslationTerms> terms(samples.begin(), samples.end());
+	if (terms.size() < 2)
+	{
+		inlierRatio = 1.0;
+		return accumulator.Solve();
+	}
+
+	std::vector<double> residuals;
+
+	auto countInliers = [&] {
+		return (size_t) std::count_if(residuals.begin(), residuals.end(), [](double residual) {
+			return residual < TranslationInlierThreshold;
+		});
+	};
+
+	// The least squares fit competes as a hypothesis too, it wins on clean data.
+	std::vector<double> bestWeights(terms.size(), 1.0);
+	Eigen::Vector3d best = accumulator.Solve();
+	TranslationResiduals(terms, bestWeights, best, residuals);
+	size_t bestInliers = countInliers();
+
+	// Fixed seed, so the same samples always give the same result.
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<size_t> pick(0, terms.size() - 1);
+
+	std::vector<double> weights(terms.size(), 0.0);
+	for (int iteration = 0; iteration < RansacIterations && !cancelled && terms.size() >= TranslationSubsetSize; iteration++)
+	{
+		size_t subset[TranslationSubsetSize];
+		for (size_t i = 0; i < TranslationSubsetSize; i++)
+			subset[i] = pick(rng);
+
+		if (subset[0] == subset[1] || subset[0] == subset[2] || subset[1] == subset[2])
+			continue;
+		if (!TranslationSubsetUsable(samples, subset))
+			continue;
+
+		std::fill(weights.begin(), weights.end(), 0.0);
+		for (size_t index : subset)
+			weights[index] = 1.0;
+
+		Eigen::Matrix3d AtA;
+		Eigen::Vector3d Atb;
+		WeightedTranslationSystem(terms, weights, AtA, Atb);
+
+		// What the axis test lets through can still leave x barely constrained along some
+		// direction, e.g. when both rotations are small.
+		Eigen::Vector3d eigenvalues = Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d>(AtA, Eigen::EigenvaluesOnly).eigenvalues();
+		if (eigenvalues[0] < TranslationSubsetMinEigenvalue || eigenvalues[0] < TranslationSubsetMinConditioning * eigenvalues[2])
+			continue;
+
+		Eigen::Vector3d x = AtA.ldlt().solve(Atb);
+		TranslationResiduals(terms, weights, x, residuals);
+
+		size_t inliers = countInliers();
+		if (inliers > bestInliers)
+		{
+			best = x;
+			bestWeights = weights;
+			bestInliers = inliers;
+		}
+	}
+
+	Eigen::Vector3d x = best;
+	weights = bestWeights;
+	for (int iteration = 0; iteration < RefineIterations && !cancelled; iteration++)
+	{
+		TranslationResiduals(terms, weights, x, residuals);
+		for (size_t k = 0; k < terms.size(); k++)
+			weights[k] = HuberWeight(residuals[k], TranslationInlierThreshold);
+
+		x = SolveWeightedTranslation(terms, weights);
+	}
+
+	TranslationResiduals(terms, weights, x, residuals);
+	inlierRatio = terms.empty() ? 0.0 : (double) countInliers() / terms.size();
+	return x;
+}
+
+Sample RotateTarget(const Sample &sample, const Eigen::Matrix3d &rot)
+{
+	Sample rotated = sample;
+	rotated.target.rot = rot * sample.target.rot;
+	rotated.target.trans = rot * sample.target.trans;
+	return rotated;
+}
+
+TranslationAccumulator JointAccumulator::Translation(const Eigen::Matrix3d &rot) const
+{
+	TranslationAccumulator translation;
+	for (auto &sample : rotation.samples)
+		translation.AddSample(RotateTarget(sample, rot));
+	return translation;
+}
+
+// Convergence targets. Residuals are RMS over the rotation deltas, as the distance between unit
+// axes, and over the pairwise translation rows, in meters. Conditioning is the ratio of the second
+// largest to largest singular value of the rotation cross-covariance, and of the smallest to
+// largest eigenvalue of the translation normal equations.
+static const double RotationMaxResidual = 0.05;
+static const double RotationMinConditioning = 0.2;
+static const double RotationMaxChange = 0.1; // Degrees.
+static const double TranslationMaxResidual = 0.01;
+static const double TranslationMinConditioning = 0.05;
+static const double TranslationMaxChange = 0.001; // Meters.
+
+bool Converged(const RotationAccumulator &accumulator, const Eigen::Matrix3d &estimate, const Eigen::Matrix3d &previous)
+{
+	const auto &sums = accumulator.sums;
+	if (sums.deltaCount < 3)
+		return false;
+
+	double n = (double) sums.deltaCount;
+	Eigen::Matrix3d crossCV = sums.refTarget - sums.refSum * sums.targetSum.transpose() / n;
+	Eigen::Vector3d singular = crossCV.jacobiSvd().singularValues();
+	if (singular[1] < RotationMinConditioning * singular[0])
+		return false;
+
+	// sum |r - R t|^2 over unit axes expands to 2n - 2 tr(R sum(t r^T)).
+	double squared = 2.0 - 2.0 * (estimate * sums.refTarget.transpose()).trace() / n;
+	if (std::sqrt(std::max<double>(squared, 0.0)) > RotationMaxResidual)
+		return false;
+
+	return Eigen::AngleAxisd(estimate * previous.transpose()).angle() * 180.0 / EIGEN_PI <= RotationMaxChange;
+}
+
+bool Converged(const TranslationAccumulator &accumulator, const Eigen::Vector3d &estimate, const Eigen::Vector3d &previous)
+{
+	if (accumulator.sampleCount < 3)
+		return false;
+
+	Eigen::Vector3d eigenvalues = Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d>(accumulator.AtA, Eigen::EigenvaluesOnly).eigenvalues();
+	if (eigenvalues[0] < TranslationMinConditioning * eigenvalues[2])
+		return false;
+
+	// Each pair contributes a row of three per device.
+	const auto &x = estimate;
+	double squared = x.dot(accumulator.AtA * x) - 2.0 * x.dot(accumulator.Atb) + accumulator.btb;
+	double rows = 2.0 * (double) accumulator.PairCount();
+	if (std::sqrt(std::max<double>(squared, 0.0) / rows) > TranslationMaxResidual)
+		return false;
+
+	return (estimate - previous).norm() <= TranslationMaxChange;
+}
+
+bool Converged(const JointAccumulator &accumulator, const JointEstimate &estimate, const JointEstimate &previous)
+{
+	return Converged(accumulator.rotation, estimate.rot, previous.rot)
+		&& Converged(accumulator.Translation(estimate.rot), estimate.trans, previous.trans);
+}
+
+JointEstimate SolveRobust(const JointAccumulator &accumulator, const std::vector<Sample> &samples, const std::atomic<bool> &cancelled, double &inlierRatio)
+{
+	double rotationInliers, translationInliers;
+
+	JointEstimate estimate;
+	estimate.rot = SolveRobust(accumulator.rotation, samples, cancelled, rotationInliers);
+
+	std::vector<Sample> rotated;
+	for (auto &sample : samples)
+		rotated.push_back(RotateTarget(sample, estimate.rot));
+
+	estimate.trans = SolveRobust(accumulator.Translation(estimate.rot), rotated, cancelled, translationInliers);
+	inlierRatio = std::min<double>(rotationInliers, translationInliers);
+	return estimate;
+}
+
+// Reference orientation change between samples worth folding in, ~6 degrees.
+static const double ContinuousMinSampleAngle = 0.1;
+
+// Difference in the angle turned by the two devices over a delta, beyond which they didn't turn
+// together, ~2 degrees.
+static const double RigidAngleTolerance = 0.035;
+
+void ContinuousAccumulator::Clear()
+{
+	*this = ContinuousAccumulator(forgetting, window);
+}
+
+void ContinuousAccumulator::Decay()
+{
+	refTarget *= forgetting;
+	refSum *= forgetting;
+	targetSum *= forgetting;
+	rotationWeight *= forgetting;
+
+	ref.Scale(forgetting);
+	target.Scale(forgetting);
+	AtA *= forgetting;
+	Atb *= forgetting;
+	btb *= forgetting;
+	translationWeight *= forgetting;
+}
+
+bool ContinuousAccumulator::AddSample(const Sample &sample)
+{
+	if (!recent.empty())
+	{
+		const Sample &last = recent[(next + recent.size() - 1) % recent.size()];
+		// Written so that the NaN from nearly equal rotations also counts as not having turned.
+		if (!(AngleFromRotationMatrix3(sample.ref.rot * last.ref.rot.transpose()) >= ContinuousMinSampleAngle))
+			return false;
+	}
+
+	RotationSums sums;
+	size_t disagreeing = 0;
+
+	for (auto &other : recent)
+	{
+		auto delta = DeltaRotationSamples(sample, other);
+		if (!delta.valid)
+			continue;
+
+		double refAngle = AngleFromRotationMatrix3(sample.ref.rot * other.ref.rot.transpose());
+		double targetAngle = AngleFromRotationMatrix3(sample.target.rot * other.target.rot.transpose());
+		if (std::abs(refAngle - targetAngle) > RigidAngleTolerance)
+			disagreeing++;
+		else
+			sums.Add(delta);
+	}
+
+	// The sample goes into the window either way, so that once the devices are attached again in
+	// a new way, the window fills up with samples that agree with each other.
+	if (recent.size() < window)
+		recent.push_back(sample);
+	else
+		recent[next] = sample;
+	next = (next + 1) % window;
+
+	if (disagreeing > sums.deltaCount)
+	{
+		rejected++;
+		return false;
+	}
+
+	Decay();
+
+	refTarget += sums.refTarget;
+	refSum += sums.refSum;
+	targetSum += sums.targetSum;
+	rotationWeight += (double) sums.deltaCount;
+
+	// Translation needs the rotation, so it only starts once there is an estimate of it.
+	if (rotationWeight >= 3.0)
+	{
+		Sample rotated = RotateTarget(sample, Solve().rot);
+		Eigen::Vector3d d = rotated.ref.trans - rotated.target.trans;
+
+		ref.Add(rotated.ref.rot.transpose(), d, translationWeight, AtA, Atb, btb);
+		target.Add(rotated.target.rot.transpose(), d, translationWeight, AtA, Atb, btb);
+		translationWeight += 1.0;
+	}
+
+	return true;
+}
+
+JointEstimate ContinuousAccumulator::Solve() const
+{
+	JointEstimate estimate;
+	if (rotationWeight > 0.0)
+		estimate.rot = KabschRotation(refTarget - refSum * targetSum.transpose() / rotationWeight);
+	if (translationWeight >= 2.0)
+		estimate.trans = SolveNormalEquations(AtA, Atb);
+	return estimate;
+}
@@ -0,0 +1,380 @@
+#pragma once
+
+// Pose samples and the calibration solvers. Nothing in here depends on OpenVR or Windows, so the
+// solvers can be built and run on their own, e.g. to replay recorded pose traces offline.
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+struct Pose
+{
+	Eigen::Matrix3d rot;
+	Eigen::Vector3d trans;
+
+	Pose() { }
+	Pose(const float (&m)[3][4])
+	{
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				rot(i,j) = m[i][j];
+			}
+		}
+		trans = Eigen::Vector3d(m[0][3], m[1][3], m[2][3]);
+	}
+	Pose(double x, double y, double z) : trans(Eigen::Vector3d(x,y,z)) { }
+};
+
+struct Sample
+{
+	Pose ref, target;
+	bool valid;
+	Sample() : valid(false) { }
+	Sample(Pose ref, Pose target) : ref(ref), target(target), valid(true) { }
+};
+
+struct DSample
+{
+	bool valid;
+	Eigen::Vector3d ref, target;
+};
+
+Eigen::Vector3d AxisFromRotationMatrix3(Eigen::Matrix3d rot);
+double AngleFromRotationMatrix3(Eigen::Matrix3d rot);
+DSample DeltaRotationSamples(Sample s1, Sample s2);
+
+// Rotation that best maps the target axes onto the reference axes, given their cross-covariance.
+Eigen::Matrix3d KabschRotation(const Eigen::Matrix3d &crossCV);
+
+// Number of threads the solvers split the pairwise work over, one per hardware thread unless set.
+// Results don't depend on it. Not to be called while a solver is running.
+void SetSolverThreadCount(unsigned threadCount);
+
+// Partial Kabsch sums over a set of rotation axis deltas.
+struct RotationSums
+{
+	Eigen::Matrix3d refTarget = Eigen::Matrix3d::Zero();
+	Eigen::Vector3d refSum = Eigen::Vector3d::Zero();
+	Eigen::Vector3d targetSum = Eigen::Vector3d::Zero();
+	size_t deltaCount = 0;
+
+	void Add(const DSample &delta)
+	{
+		refTarget += delta.ref * delta.target.transpose();
+		refSum += delta.ref;
+		targetSum += delta.target;
+		deltaCount++;
+	}
+
+	void Add(const RotationSums &other)
+	{
+		refTarget += other.refTarget;
+		refSum += other.refSum;
+		targetSum += other.targetSum;
+		deltaCount += other.deltaCount;
+	}
+};
+
+// Running Kabsch cross-covariance of the rotation axes between every pair of samples.
+//
+// Each new sample is compared against the previous ones as it arrives, and its deltas are folded
+// into the sums of the outer products and centroids. Centering is deferred to the solve, since
+// sum((r - rc)(t - tc)^T) = sum(r t^T) - n rc tc^T, which leaves only a 3x3 SVD per estimate.
+struct RotationAccumulator
+{
+	// Number of sample pairs per unit of work handed to the thread pool. Tiles are fixed regardless
+	// of the number of threads and reduced in order, so results don't depend on the thread count.
+	static const size_t TileSize = 64;
+
+	std::vector<Sample> samples;
+	RotationSums sums;
+
+	void AddSample(const Sample &sample)
+	{
+		AddSamples(&sample, 1);
+	}
+
+	void AddSamples(const Sample *newSamples, size_t count);
+
+	size_t DeltaCount() const
+	{
+		return sums.deltaCount;
+	}
+
+	bool CanSolve() const
+	{
+		return sums.deltaCount >= 3;
+	}
+
+	Eigen::Matrix3d Solve() const
+	{
+		Eigen::Matrix3d crossCV = sums.refTarget - sums.refSum * sums.targetSum.transpose() / (double) sums.deltaCount;
+		return KabschRotation(crossCV);
+	}
+};
+
+Eigen::Vector3d EulerFromRotation(const Eigen::Matrix3d &rot);
+
+Eigen::Vector3d SolveNormalEquations(const Eigen::Matrix3d &AtA, const Eigen::Vector3d &Atb);
+
+// Accumulates the normal equations of the pairwise translation problem.
+//
+// Every pair of samples (i, j) contributes the rows (Qj - Qi) x = Qj dj - Qi di, once with the
+// reference rotation and once with the target rotation, where Q is the transposed device rotation
+// and d = ref.trans - target.trans. Summed over all j < i, the contribution of a new sample i
+// expands into a handful of running sums over the previous samples, so each sample is folded in
+// with constant work and the accumulator never grows.
+struct TranslationAccumulator
+{
+	struct DeviceSums
+	{
+		Eigen::Matrix3d Q = Eigen::Matrix3d::Zero();
+		Eigen::Matrix3d QtQ = Eigen::Matrix3d::Zero();
+		Eigen::Vector3d C = Eigen::Vector3d::Zero();
+		Eigen::Vector3d QtC = Eigen::Vector3d::Zero();
+		double CtC = 0.0;
+
+		void Add(const Eigen::Matrix3d &q, const Eigen::Vector3d &d, double n, Eigen::Matrix3d &AtA, Eigen::Vector3d &Atb, double &btb)
+		{
+			Eigen::Vector3d c = q * d;
+			Eigen::Matrix3d qtq = q.transpose() * q;
+
+			AtA += QtQ - Q.transpose() * q - q.transpose() * Q + n * qtq;
+			Atb += QtC - Q.transpose() * c - q.transpose() * C + n * (q.transpose() * c);
+			btb += CtC - 2.0 * C.dot(c) + n * c.squaredNorm();
+
+			Q += q;
+			QtQ += qtq;
+			C += c;
+			QtC += q.transpose() * c;
+			CtC += c.squaredNorm();
+		}
+
+		void Scale(double factor)
+		{
+			Q *= factor;
+			QtQ *= factor;
+			C *= factor;
+			QtC *= factor;
+			CtC *= factor;
+		}
+	};
+
+	DeviceSums ref, target;
+	Eigen::Matrix3d AtA = Eigen::Matrix3d::Zero();
+	Eigen::Vector3d Atb = Eigen::Vector3d::Zero();
+	double btb = 0.0; // Sum of the squared right hand sides, for the residual.
+	size_t sampleCount = 0;
+
+	void AddSample(const Sample &sample)
+	{
+		Eigen::Vector3d d = sample.ref.trans - sample.target.trans;
+		double n = (double) sampleCount;
+
+		ref.Add(sample.ref.rot.transpose(), d, n, AtA, Atb, btb);
+		target.Add(sample.target.rot.transpose(), d, n, AtA, Atb, btb);
+		sampleCount++;
+	}
+
+	void AddSamples(const Sample *newSamples, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			AddSample(newSamples[i]);
+	}
+
+	size_t PairCount() const
+	{
+		return sampleCount * (sampleCount - 1) / 2;
+	}
+
+	bool CanSolve() const
+	{
+		return sampleCount >= 2;
+	}
+
+	Eigen::Vector3d Solve() const
+	{
+		return SolveNormalEquations(AtA, Atb);
+	}
+};
+
+struct JointEstimate
+{
+	Eigen::Matrix3d rot = Eigen::Matrix3d::Identity();
+	Eigen::Vector3d trans = Eigen::Vector3d::Zero();
+};
+
+// The sample the translation phase would have collected with the rotation already applied to the
+// target device by the driver.
+Sample RotateTarget(const Sample &sample, const Eigen::Matrix3d &rot);
+
+// Hand-eye calibration of rotation and translation from a single set of samples, in the two steps
+// of Tsai and Lenz: the rotation from the axes of the rotation deltas, then the translation from
+// the same samples with that rotation applied to the target. This is the same pair of problems the
+// sequential mode solves, without moving the devices through a second round of samples.
+struct JointAccumulator
+{
+	RotationAccumulator rotation;
+
+	void AddSamples(const Sample *newSamples, size_t count)
+	{
+		rotation.AddSamples(newSamples, count);
+	}
+
+	bool CanSolve() const
+	{
+		return rotation.CanSolve();
+	}
+
+	// The translation sums depend on the rotation, so they are rebuilt for each estimate.
+	TranslationAccumulator Translation(const Eigen::Matrix3d &rot) const;
+
+	JointEstimate Solve() const
+	{
+		JointEstimate estimate;
+		estimate.rot = rotation.Solve();
+		estimate.trans = Translation(estimate.rot).Solve();
+		return estimate;
+	}
+};
+
+// Whether more samples would hardly change an estimate, for ending sample collection early: the
+// problem is well conditioned (the devices were turned about more than one axis), the data fits
+// the estimate, and it has stopped moving since `previous`, the estimate ConvergenceWindow samples
+// earlier. All three are read off the accumulated sums, without going back over the samples.
+static const size_t ConvergenceWindow = 20;
+
+bool Converged(const RotationAccumulator &accumulator, const Eigen::Matrix3d &estimate, const Eigen::Matrix3d &previous);
+bool Converged(const TranslationAccumulator &accumulator, const Eigen::Vector3d &estimate, const Eigen::Vector3d &previous);
+bool Converged(const JointAccumulator &accumulator, const JointEstimate &estimate, const JointEstimate &previous);
+
+// Robust fits, for sample sets with tracking glitches in them (reflections, occlusion, a device
+// slipping in the hand). RANSAC over minimal subsets finds the model most of the data agrees with,
+// then iteratively reweighted least squares with Huber weights refines it over all of the data,
+// so that outliers only pull on the result linearly instead of quadratically.
+Eigen::Matrix3d SolveRobust(const RotationAccumulator &accumulator, const std::vector<Sample> &samples, const std::atomic<bool> &cancelled, double &inlierRatio);
+Eigen::Vector3d SolveRobust(const TranslationAccumulator &accumulator, const std::vector<Sample> &samples, const std::atomic<bool> &cancelled, double &inlierRatio);
+
+// Reports the lower of the two inlier ratios.
+JointEstimate SolveRobust(const JointAccumulator &accumulator, const std::vector<Sample> &samples, const std::atomic<bool> &cancelled, double &inlierRatio);
+
+// Rotation and translation estimate for continuous calibration, for a reference and target device
+// that stay attached to each other through a session, e.g. a tracker strapped to the HMD.
+//
+// Everything accumulated so far is scaled down by the forgetting factor before each new sample is
+// folded in, so the estimate follows slow drift between the two tracking systems instead of
+// averaging over the whole session. Rotation deltas are only taken against a window of recent
+// samples, and translation samples are rotated by the estimate at the time they arrive instead of
+// being rebuilt for each solve, so every sample costs the same bounded work however long it runs.
+class ContinuousAccumulator
+{
+public:
+	ContinuousAccumulator(double forgetting = 0.99, size_t window = 32) : forgetting(forgetting), window(window) { }
+
+	// Folds a sample in, returning false if it was skipped. Samples are skipped while the reference
+	// hasn't turned far enough since the last one to add information, and when most of their
+	// rotation deltas disagree on the angle turned, which means the devices moved relative to each
+	// other instead of together.
+	bool AddSample(const Sample &sample);
+
+	void Clear();
+
+	// Effective number of samples the estimate rests on. Approaches 1 / (1 - forgetting).
+	double Weight() const { return translationWeight; }
+
+	size_t Rejected() const { return rejected; }
+
+	bool CanSolve() const { return rotationWeight >= 3.0 && translationWeight >= 2.0; }
+
+	JointEstimate Solve() const;
+
+private:
+	void Decay();
+
+	double forgetting;
+	size_t window;
+	std::vector<Sample> recent;
+	size_t next = 0;
+	size_t rejected = 0;
+
+	Eigen::Matrix3d refTarget = Eigen::Matrix3d::Zero();
+	Eigen::Vector3d refSum = Eigen::Vector3d::Zero();
+	Eigen::Vector3d targetSum = Eigen::Vector3d::Zero();
+	double rotationWeight = 0.0;
+
+	TranslationAccumulator::DeviceSums ref, target;
+	Eigen::Matrix3d AtA = Eigen::Matrix3d::Zero();
+	Eigen::Vector3d Atb = Eigen::Vector3d::Zero();
+	double btb = 0.0;
+	double translationWeight = 0.0;
+};
+
+// Picks the samples worth handing to the solvers out of the full rate pose stream, and tells when
+// a phase has seen enough of them.
+//
+// Samples are only kept when they add a new reference orientation, judged on a grid over the
+// vector part of the orientation quaternion, where a cell of 0.1 is about 11 degrees of rotation.
+// Nearly identical orientations produce rotation deltas that DeltaRotationSamples rejects anyway,
+// and holding still or going over the same orientations again adds little but noise, so they are
+// not worth the pairwise work.
+//
+// Coverage is saturated once MinSamples are kept and the cells entered over the last
+// SaturationInterval added no more than SaturationGrowth to the coverage. A phase ends there rather
+// than at its sample count, which remains the cap, so the more a user has already covered, the
+// more new orientations it takes to keep a phase going.
+class SampleSelector
+{
+public:
+	static const size_t MinSamples = 30;
+	static constexpr double SaturationInterval = 2.0;
+	static constexpr double SaturationGrowth = 0.1;
+
+	// time is the sample's timestamp in seconds, on any clock as long as it doesn't go backwards.
+	bool Accept(const Sample &sample, double time)
+	{
+		Eigen::Quaterniond q(sample.ref.rot);
+		if (q.w() < 0)
+			q.coeffs() = -q.coeffs();
+
+		size_t index = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			int cell = (int) std::floor((q.vec()[axis] + 1.0) / CellSize);
+			index = index * CellsPerAxis + std::min<int>(std::max<int>(cell, 0), CellsPerAxis - 1);
+		}
+
+		if (occupied[index])
+			return false;
+
+		occupied[index] = true;
+		acceptedTimes.push_back(time);
+		return true;
+	}
+
+	bool Saturated(double time) const
+	{
+		if (acceptedTimes.size() < MinSamples || time - acceptedTimes.front() < SaturationInterval)
+			return false;
+
+		auto recent = acceptedTimes.end() - std::lower_bound(acceptedTimes.begin(), acceptedTimes.end(), time - SaturationInterval);
+		return recent <= SaturationGrowth * acceptedTimes.size();
+	}
+
+	void Clear()
+	{
+		occupied.reset();
+		acceptedTimes.clear();
+	}
+
+private:
+	static constexpr double CellSize = 0.1;
+	static const int CellsPerAxis = 20;
+
+	std::bitset<CellsPerAxis * CellsPerAxis * CellsPerAxis> occupied;
+	std::vector<double> acceptedTimes; // Of the samples kept, in order.
+};
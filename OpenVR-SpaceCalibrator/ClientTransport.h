@@ -0,0 +1,25 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+// Carries whole protocol frames between the client and the driver, see Protocol.h. Frames arrive
+// whole and in the order they were sent.
+class ClientTransport
+{
+public:
+	virtual ~ClientTransport() { }
+
+	// Throws if the driver can't be reached.
+	virtual void Connect() = 0;
+
+	// Starts sending a frame without waiting for the driver to read it.
+	virtual void Write(std::string frame) = 0;
+
+	// Points data at the next frame received, valid until the next call. Returns false if none
+	// has arrived yet, unless told to wait for one.
+	virtual bool Read(const char *&data, size_t &size, bool wait) = 0;
+};
+
+// Named pipes on Windows, a Unix domain socket elsewhere.
+std::unique_ptr<ClientTransport> CreateClientTransport();
@@ -62,6 +62,37 @@ static void ParseProfile(CalibrationContext &ctx, std::istream &stream)
 	if (obj["calibration_speed"].is<double>())
 		ctx.calibrationSpeed = (CalibrationContext::Speed)(int) obj["calibration_speed"].get<double>();
 
+	if (obj["calibration_mode"].is<double>())
+		ctx.calibrationMode = (CalibrationContext::Mode)(int) obj["calibration_mode"].get<double>();
+
+	if (obj["sampler_rate"].is<double>())
+	{
+		// Hand edited profiles could ask for a zero, negative or absurd rate, and NaN fails both
+		// comparisons, so it keeps the default.
+		double rate = obj["sampler_rate"].get<double>();
+		if (rate < CalibrationContext::MinSamplerRate)
+			ctx.samplerRate = CalibrationContext::MinSamplerRate;
+		else if (rate > CalibrationContext::MaxSamplerRate)
+			ctx.samplerRate = CalibrationContext::MaxSamplerRate;
+		else if (rate == rate)
+			ctx.samplerRate = rate;
+	}
+
+	if (obj["driver_pose_capture"].is<bool>())
+		ctx.driverPoseCapture = obj["driver_pose_capture"].get<bool>();
+
+	if (obj["continuous_calibration"].is<bool>())
+		ctx.continuousCalibration = obj["continuous_calibration"].get<bool>();
+
+	if (obj["robust_solve"].is<bool>())
+		ctx.robustSolve = obj["robust_solve"].get<bool>();
+
+	if (obj["adaptive_sample_count"].is<bool>())
+		ctx.adaptiveSampleCount = obj["adaptive_sample_count"].get<bool>();
+
+	if (obj["record_trace"].is<bool>())
+		ctx.recordTrace = obj["record_trace"].get<bool>();
+
 	if (obj["chaperone"].is<picojson::object>())
 	{
 		auto chaperone = obj["chaperone"].get<picojson::object>();
@@ -111,6 +142,15 @@ static void WriteProfile(CalibrationContext &ctx, std::ostream &out)
 	double speed = (int) ctx.calibrationSpeed;
 	profile["calibration_speed"].set<double>(speed);
 
+	double mode = (int) ctx.calibrationMode;
+	profile["calibration_mode"].set<double>(mode);
+	profile["sampler_rate"].set<double>(ctx.samplerRate);
+	profile["driver_pose_capture"].set<bool>(ctx.driverPoseCapture);
+	profile["continuous_calibration"].set<bool>(ctx.continuousCalibration);
+	profile["robust_solve"].set<bool>(ctx.robustSolve);
+	profile["adaptive_sample_count"].set<bool>(ctx.adaptiveSampleCount);
+	profile["record_trace"].set<bool>(ctx.recordTrace);
+
 	if (ctx.chaperone.valid)
 	{
 		picojson::object chaperone;
@@ -151,6 +191,22 @@ static void LogRegistryResult(LSTATUS result)
 
 static const char *RegistryKey = "Software\\OpenVR-SpaceCalibrator";
 
+std::string DataDirectory()
+{
+	char *localAppData = nullptr;
+	size_t length = 0;
+	if (_dupenv_s(&localAppData, &length, "LOCALAPPDATA") != 0 || !localAppData)
+		return "";
+
+	std::string dir = std::string(localAppData) + "\\OpenVR-SpaceCalibrator";
+	free(localAppData);
+
+	if (!CreateDirectoryA(dir.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+		return "";
+
+	return dir + "\\";
+}
+
 static std::string ReadRegistryKey()
 {
 	DWORD size = 0;
@@ -2,5 +2,12 @@
 
 #include "Calibration.h"
 
+#include <string>
+
 void LoadProfile(CalibrationContext &ctx);
 void SaveProfile(CalibrationContext &ctx);
+
+// Per user directory, with a trailing separator, for the files the calibrator writes besides its
+// profile, which lives in the registry. Created on first use. Empty, meaning the working
+// directory, if it can't be.
+std::string DataDirectory();
@@ -0,0 +1,107 @@
+#include "stdafx.h"
+#include "DeviceRegistry.h"
+
+DeviceRegistry Devices;
+
+// How often every slot is re-read regardless of events.
+static const double RescanInterval = 10.0;
+
+static bool SameDevice(const DeviceInfo &a, const DeviceInfo &b)
+{
+	return a.deviceClass == b.deviceClass
+		&& a.hasTrackingSystem == b.hasTrackingSystem
+		&& a.trackingSystem == b.trackingSystem
+		&& a.model == b.model
+		&& a.serial == b.serial
+		&& a.controllerRole == b.controllerRole;
+}
+
+bool DeviceRegistry::Update(double time)
+{
+	bool changed = false;
+	bool rescan = !scanned || (time - timeLastRescan) >= RescanInterval;
+
+	vr::VREvent_t event;
+	while (vr::VRSystem()->PollNextEvent(&event, sizeof event))
+	{
+		switch (event.eventType)
+		{
+		case vr::VREvent_TrackedDeviceActivated:
+		case vr::VREvent_TrackedDeviceDeactivated:
+		case vr::VREvent_TrackedDeviceUpdated:
+			if (event.trackedDeviceIndex < vr::k_unMaxTrackedDeviceCount)
+				changed |= Refresh(event.trackedDeviceIndex);
+			break;
+
+		case vr::VREvent_PropertyChanged:
+			switch (event.data.property.prop)
+			{
+			case vr::Prop_TrackingSystemName_String:
+			case vr::Prop_ModelNumber_String:
+			case vr::Prop_SerialNumber_String:
+			case vr::Prop_ControllerRoleHint_Int32:
+				if (event.trackedDeviceIndex < vr::k_unMaxTrackedDeviceCount)
+					changed |= Refresh(event.trackedDeviceIndex);
+				break;
+			}
+			break;
+
+		case vr::VREvent_TrackedDeviceRoleChanged:
+		case vr::VREvent_ChaperoneUniverseHasChanged:
+			rescan = true;
+			break;
+		}
+	}
+
+	if (rescan)
+	{
+		changed |= Rescan();
+		timeLastRescan = time;
+		scanned = true;
+	}
+
+	return changed;
+}
+
+bool DeviceRegistry::Rescan()
+{
+	bool changed = false;
+	for (uint32_t id = 0; id < vr::k_unMaxTrackedDeviceCount; ++id)
+		changed |= Refresh(id);
+
+	return changed;
+}
+
+bool DeviceRegistry::Refresh(uint32_t id)
+{
+	DeviceInfo info;
+	info.deviceClass = vr::VRSystem()->GetTrackedDeviceClass(id);
+
+	if (info.deviceClass != vr::TrackedDeviceClass_Invalid)
+	{
+		char buffer[vr::k_unMaxPropertyStringSize];
+		vr::ETrackedPropertyError err = vr::TrackedProp_Success;
+
+		vr::VRSystem()->GetStringTrackedDeviceProperty(id, vr::Prop_TrackingSystemName_String, buffer, vr::k_unMaxPropertyStringSize, &err);
+		info.hasTrackingSystem = err == vr::TrackedProp_Success;
+		if (info.hasTrackingSystem)
+			info.trackingSystem = buffer;
+		else if (info.deviceClass != vr::TrackedDeviceClass_TrackingReference)
+			printf("failed to get tracking system name for id %d\n", id);
+
+		vr::VRSystem()->GetStringTrackedDeviceProperty(id, vr::Prop_ModelNumber_String, buffer, vr::k_unMaxPropertyStringSize, &err);
+		info.model = buffer;
+
+		vr::VRSystem()->GetStringTrackedDeviceProperty(id, vr::Prop_SerialNumber_String, buffer, vr::k_unMaxPropertyStringSize, &err);
+		info.serial = buffer;
+
+		info.controllerRole = (vr::ETrackedControllerRole) vr::VRSystem()->GetInt32TrackedDeviceProperty(id, vr::Prop_ControllerRoleHint_Int32, &err);
+	}
+
+	if (SameDevice(info, devices[id]))
+		return false;
+
+	devices[id] = info;
+	generation++;
+	return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <openvr.h>
+#include <string>
+
+struct DeviceInfo
+{
+	vr::ETrackedDeviceClass deviceClass = vr::TrackedDeviceClass_Invalid;
+	bool hasTrackingSystem = false;
+	std::string trackingSystem, model, serial;
+	vr::ETrackedControllerRole controllerRole = vr::TrackedControllerRole_Invalid;
+};
+
+// Cached properties of every tracked device slot.
+//
+// Slots are refreshed when OpenVR reports a device being activated, deactivated or updated, so
+// reading the cache costs no OpenVR calls. Role and universe changes refresh every slot, and so
+// does a slow periodic rescan, in case an event was missed.
+class DeviceRegistry
+{
+public:
+	// Drains the system event queue and refreshes the slots it touches. Returns true if any
+	// device changed.
+	bool Update(double time);
+
+	const DeviceInfo &Device(uint32_t id) const { return devices[id]; }
+
+	// Incremented on every change, so state derived from the devices can be rebuilt only when
+	// this differs from the last time it was built.
+	uint64_t Generation() const { return generation; }
+
+private:
+	bool Rescan();
+	bool Refresh(uint32_t id);
+
+	DeviceInfo devices[vr::k_unMaxTrackedDeviceCount];
+	uint64_t generation = 0;
+	double timeLastRescan = 0;
+	bool scanned = false;
+};
+
+extern DeviceRegistry Devices;
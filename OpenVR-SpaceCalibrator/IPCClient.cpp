@@ -1,46 +1,30 @@
-#include "stdafx.h"
 #include "IPCClient.h"
 
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
 #include <string>
 
-static std::string LastErrorString(DWORD lastError)
-{
-	LPSTR buffer = nullptr;
-	size_t size = FormatMessageA(
-		FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-		NULL, lastError, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&buffer, 0, NULL
-	);
-
-	std::string message(buffer, size);
-	LocalFree(buffer);
-	return message;
-}
-
-IPCClient::~IPCClient()
-{
-	if (pipe && pipe != INVALID_HANDLE_VALUE)
-		CloseHandle(pipe);
-}
-
 void IPCClient::Connect()
 {
-	LPTSTR pipeName = TEXT(OPENVR_SPACECALIBRATOR_PIPE_NAME);
+	transport = CreateClientTransport();
+	transport->Connect();
 
-	WaitNamedPipe(pipeName, 1000);
-	pipe = CreateFile(pipeName, GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, 0, 0);
+	protocol::Request request(protocol::RequestHandshake);
+	request.protocol = protocol::Protocol();
 
-	if (pipe == INVALID_HANDLE_VALUE)
+	// Drivers from before the framed protocol answer with something that doesn't decode.
+	protocol::Response response;
+	try
 	{
-		throw std::runtime_error("Space Calibrator driver unavailable. Make sure SteamVR is running, and the Space Calibrator addon is enabled in SteamVR settings.");
+		response = SendBlocking(request);
 	}
-
-	DWORD mode = PIPE_READMODE_MESSAGE;
-	if (!SetNamedPipeHandleState(pipe, &mode, 0, 0))
+	catch (const std::runtime_error &)
 	{
-		throw std::runtime_error("Couldn't set pipe mode. Error: " + LastErrorString(GetLastError()));
+		response.type = protocol::ResponseInvalid;
+		response.protocol.version = 0;
 	}
 
-	auto response = SendBlocking(protocol::Request(protocol::RequestHandshake));
 	if (response.type != protocol::ResponseHandshake || response.protocol.version != protocol::Version)
 	{
 		throw std::runtime_error(
@@ -51,43 +35,145 @@ void IPCClient::Connect()
 			")"
 		);
 	}
+
+	capabilities = response.protocol.capabilities;
+
+	if (Supports(protocol::CapabilitySharedTransforms) && !sharedTransforms.Open())
+		capabilities &= ~protocol::CapabilitySharedTransforms;
+
+	// A previous client that died mid-write can't finish it now. Its half written transforms are
+	// replaced when the profile is applied again.
+	if (Supports(protocol::CapabilitySharedTransforms))
+	{
+		for (auto &slot : sharedTransforms.Get()->devices)
+			slot.Recover();
+	}
+
+	if (Supports(protocol::CapabilityPoseCapture) && !poseCapture.Open())
+		capabilities &= ~protocol::CapabilityPoseCapture;
 }
 
-protocol::Response IPCClient::SendBlocking(const protocol::Request &request)
+void IPCClient::Send(const protocol::Request &request, Completion completion)
 {
-	Send(request);
-	return Receive();
+	transport->Write(protocol::EncodeRequest(request, nextSequence));
+	inFlight.push_back({ nextSequence++, std::move(completion) });
 }
 
-void IPCClient::Send(const protocol::Request &request)
+void IPCClient::SetDeviceTransforms(const protocol::SetDeviceTransform *transforms, uint32_t count, Completion completion)
 {
-	DWORD bytesWritten;
-	BOOL success = WriteFile(pipe, &request, sizeof request, &bytesWritten, 0);
-	if (!success)
+	if (count > vr::k_unMaxTrackedDeviceCount)
+		throw std::runtime_error("Too many device transforms: " + std::to_string(count));
+
+	if (count == 0 || Supports(protocol::CapabilitySharedTransforms))
+	{
+		auto table = sharedTransforms.Get();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const auto &update = transforms[i];
+			if (update.openVRID >= vr::k_unMaxTrackedDeviceCount)
+				throw std::runtime_error("Invalid device id " + std::to_string(update.openVRID));
+
+			table->devices[update.openVRID].Modify([&](protocol::DeviceTransform &tf) {
+				protocol::ApplyTransformUpdate(tf, update);
+			});
+		}
+
+		if (completion)
+			completion(protocol::Response(protocol::ResponseSuccess));
+		return;
+	}
+
+	if (count == 1 || !Supports(protocol::CapabilityTransformBatch))
 	{
-		throw std::runtime_error("Error writing IPC request. Error: " + LastErrorString(GetLastError()));
+		// One request each, and the completion gets the first failure if there was one.
+		auto remaining = std::make_shared<uint32_t>(count);
+		auto result = std::make_shared<protocol::Response>(protocol::ResponseSuccess);
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			protocol::Request request(protocol::RequestSetDeviceTransform);
+			request.setDeviceTransform = transforms[i];
+			Send(request, [=](const protocol::Response &response) {
+				if (response.type != protocol::ResponseSuccess && result->type == protocol::ResponseSuccess)
+					*result = response;
+				if (--*remaining == 0 && completion)
+					completion(*result);
+			});
+		}
+		return;
 	}
+
+	protocol::Request request(protocol::RequestSetDeviceTransformBatch);
+	auto &batch = request.setDeviceTransformBatch;
+	batch.count = count;
+	std::copy(transforms, transforms + count, batch.transforms);
+	Send(request, std::move(completion));
+}
+
+void IPCClient::GetPoseHookStats(uint32_t openVRID, std::function<void(const protocol::PoseHookStats &)> completion)
+{
+	if (!Supports(protocol::CapabilityPoseHookStats))
+		return;
+
+	protocol::Request request(protocol::RequestGetPoseHookStats);
+	request.getPoseHookStats.openVRID = openVRID;
+	Send(request, [completion](const protocol::Response &response) {
+		if (response.type == protocol::ResponsePoseHookStats)
+			completion(response.poseHookStats);
+	});
 }
 
-protocol::Response IPCClient::Receive()
+void IPCClient::Poll()
+{
+	while (Receive(false));
+}
+
+protocol::Response IPCClient::SendBlocking(const protocol::Request &request)
 {
 	protocol::Response response(protocol::ResponseInvalid);
-	DWORD bytesRead;
+	bool done = false;
+
+	Send(request, [&](const protocol::Response &r) {
+		response = r;
+		done = true;
+	});
+
+	while (!done)
+		Receive(true);
 
-	BOOL success = ReadFile(pipe, &response, sizeof response, &bytesRead, 0);
-	if (!success)
+	return response;
+}
+
+// Handles the next response if it has arrived, or once it arrives if waiting. Returns false if
+// there was none to handle.
+bool IPCClient::Receive(bool wait)
+{
+	if (inFlight.empty())
+		return false;
+
+	const char *data;
+	size_t size;
+	if (!transport->Read(data, size, wait))
+		return false;
+
+	protocol::Response response(protocol::ResponseInvalid);
+	uint32_t sequence;
+	if (!protocol::DecodeResponse(data, size, response, sequence))
 	{
-		DWORD lastError = GetLastError();
-		if (lastError != ERROR_MORE_DATA)
-		{
-			throw std::runtime_error("Error reading IPC response. Error: " + LastErrorString(lastError));
-		}
+		throw std::runtime_error("Invalid IPC response with size " + std::to_string(size));
 	}
 
-	if (bytesRead != sizeof response)
+	// Requests are answered in order, so this answers the oldest one still waiting.
+	auto pending = std::move(inFlight.front());
+	inFlight.pop_front();
+
+	if (sequence != pending.sequence)
 	{
-		throw std::runtime_error("Invalid IPC response with size " + std::to_string(bytesRead));
+		throw std::runtime_error("Unexpected IPC response sequence " + std::to_string(sequence));
 	}
 
-	return response;
+	if (pending.completion)
+		pending.completion(response);
+
+	return true;
 }
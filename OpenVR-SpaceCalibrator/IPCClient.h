@@ -1,18 +1,66 @@
 #pragma once
 
+#include "../PoseCapture.h"
 #include "../Protocol.h"
+#include "../SharedTransforms.h"
+#include "ClientTransport.h"
 
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Client end of the driver connection.
+//
+// Send() writes a request without waiting for the driver, so any number can be in flight. The
+// driver answers them in order, and Poll() runs the completions of whatever answers have arrived
+// on the calling thread. Meant to be used from a single thread.
 class IPCClient
 {
 public:
-	~IPCClient();
+	typedef std::function<void(const protocol::Response &)> Completion;
 
 	void Connect();
+
+	// Returns once the request is queued on the transport. The completion runs in a later Poll().
+	void Send(const protocol::Request &request, Completion completion = nullptr);
+
+	// Runs the completions of every response that has arrived, without waiting for more.
+	void Poll();
+
+	// Waits for the response to this request, completing any sent before it on the way.
 	protocol::Response SendBlocking(const protocol::Request &request);
 
-	void Send(const protocol::Request &request);
-	protocol::Response Receive();
+	// Applies device transforms the quickest way the driver supports. Through the shared transform
+	// table they take effect immediately and the completion runs before this returns, otherwise they
+	// are sent as requests, batched if possible, and it runs once the driver has answered them all.
+	void SetDeviceTransforms(const protocol::SetDeviceTransform *transforms, uint32_t count, Completion completion = nullptr);
+
+	// Asks for the driver's pose hook counters of a device. The completion runs in a later Poll(),
+	// and never if the driver doesn't keep them or fails the request.
+	void GetPoseHookStats(uint32_t openVRID, std::function<void(const protocol::PoseHookStats &)> completion);
+
+	// The driver's raw pose capture ring, or null if the driver doesn't offer it.
+	protocol::PoseCaptureRing *PoseCapture() const { return poseCapture.Get(); }
+
+	size_t InFlight() const { return inFlight.size(); }
+
+	// Capabilities agreed on with the driver during Connect().
+	bool Supports(protocol::Capability capability) const { return (capabilities & capability) != 0; }
 
 private:
-	HANDLE pipe = INVALID_HANDLE_VALUE;
-};
\ No newline at end of file
+	struct PendingResponse
+	{
+		uint32_t sequence;
+		Completion completion;
+	};
+
+	bool Receive(bool wait);
+
+	std::unique_ptr<ClientTransport> transport;
+	protocol::SharedTransformMapping sharedTransforms;
+	protocol::PoseCaptureMapping poseCapture;
+	uint32_t capabilities = 0;
+	uint32_t nextSequence = 0;
+	std::deque<PendingResponse> inFlight;
+};
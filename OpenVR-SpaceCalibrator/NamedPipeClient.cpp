@@ -0,0 +1,129 @@
+#ifdef _WIN32
+
+#include "NamedPipeClient.h"
+
+#include <stdexcept>
+
+static std::string LastErrorString(DWORD lastError)
+{
+	LPSTR buffer = nullptr;
+	size_t size = FormatMessageA(
+		FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+		NULL, lastError, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&buffer, 0, NULL
+	);
+
+	std::string message(buffer, size);
+	LocalFree(buffer);
+	return message;
+}
+
+std::unique_ptr<ClientTransport> CreateClientTransport()
+{
+	return std::unique_ptr<ClientTransport>(new NamedPipeClient());
+}
+
+NamedPipeClient::~NamedPipeClient()
+{
+	if (pipe && pipe != INVALID_HANDLE_VALUE)
+	{
+		// The buffers of outstanding reads and writes have to outlive them.
+		CancelIoEx(pipe, nullptr);
+
+		DWORD bytes;
+		if (reading)
+			GetOverlappedResult(pipe, &readOverlap, &bytes, TRUE);
+		for (auto &write : writes)
+			GetOverlappedResult(pipe, &write->overlap, &bytes, TRUE);
+
+		CloseHandle(pipe);
+	}
+
+	if (readOverlap.hEvent)
+		CloseHandle(readOverlap.hEvent);
+}
+
+void NamedPipeClient::Connect()
+{
+	LPTSTR pipeName = TEXT(OPENVR_SPACECALIBRATOR_PIPE_NAME);
+
+	WaitNamedPipe(pipeName, 1000);
+	pipe = CreateFile(pipeName, GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0);
+
+	if (pipe == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Space Calibrator driver unavailable. Make sure SteamVR is running, and the Space Calibrator addon is enabled in SteamVR settings.");
+	}
+
+	DWORD mode = PIPE_READMODE_MESSAGE;
+	if (!SetNamedPipeHandleState(pipe, &mode, 0, 0))
+	{
+		throw std::runtime_error("Couldn't set pipe mode. Error: " + LastErrorString(GetLastError()));
+	}
+
+	readOverlap.hEvent = CreateEvent(0, TRUE, FALSE, 0);
+	if (!readOverlap.hEvent)
+	{
+		throw std::runtime_error("Couldn't create pipe event. Error: " + LastErrorString(GetLastError()));
+	}
+}
+
+void NamedPipeClient::Write(std::string frame)
+{
+	std::unique_ptr<PendingWrite> write(new PendingWrite());
+	write->frame = std::move(frame);
+
+	BOOL success = WriteFile(pipe, write->frame.data(), (DWORD) write->frame.size(), nullptr, &write->overlap);
+	if (!success && GetLastError() != ERROR_IO_PENDING)
+	{
+		throw std::runtime_error("Error writing IPC request. Error: " + LastErrorString(GetLastError()));
+	}
+
+	writes.push_back(std::move(write));
+	ReapWrites();
+}
+
+void NamedPipeClient::ReapWrites()
+{
+	while (!writes.empty() && HasOverlappedIoCompleted(&writes.front()->overlap))
+	{
+		DWORD bytesWritten;
+		if (!GetOverlappedResult(pipe, &writes.front()->overlap, &bytesWritten, FALSE))
+		{
+			throw std::runtime_error("Error writing IPC request. Error: " + LastErrorString(GetLastError()));
+		}
+		writes.pop_front();
+	}
+}
+
+bool NamedPipeClient::Read(const char *&data, size_t &size, bool wait)
+{
+	ReapWrites();
+
+	if (!reading)
+	{
+		BOOL success = ReadFile(pipe, buffer, sizeof buffer, nullptr, &readOverlap);
+		if (!success && GetLastError() != ERROR_IO_PENDING)
+		{
+			throw std::runtime_error("Error reading IPC response. Error: " + LastErrorString(GetLastError()));
+		}
+		reading = true;
+	}
+
+	DWORD bytesRead;
+	if (!GetOverlappedResult(pipe, &readOverlap, &bytesRead, wait))
+	{
+		DWORD lastError = GetLastError();
+		if (lastError == ERROR_IO_INCOMPLETE)
+			return false;
+
+		reading = false;
+		throw std::runtime_error("Error reading IPC response. Error: " + LastErrorString(lastError));
+	}
+	reading = false;
+
+	data = buffer;
+	size = bytesRead;
+	return true;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#ifdef _WIN32
+
+#include "ClientTransport.h"
+#include "../Protocol.h"
+
+#include <deque>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// Overlapped named pipe client. Writes are left in flight until they complete, and one read is
+// kept outstanding while a response is expected.
+class NamedPipeClient : public ClientTransport
+{
+public:
+	~NamedPipeClient();
+
+	void Connect() override;
+	void Write(std::string frame) override;
+	bool Read(const char *&data, size_t &size, bool wait) override;
+
+private:
+	struct PendingWrite
+	{
+		OVERLAPPED overlap;
+		std::string frame;
+	};
+
+	void ReapWrites();
+
+	HANDLE pipe = INVALID_HANDLE_VALUE;
+	std::deque<std::unique_ptr<PendingWrite>> writes;
+
+	OVERLAPPED readOverlap = {};
+	bool reading = false;
+	char buffer[protocol::MaxFrameSize];
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include "stdafx.h"
+#include "PoseSampler.h"
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <Eigen/Geometry>
+#include <mmsystem.h>
+
+#pragma comment(lib, "winmm.lib")
+
+PoseSampler::~PoseSampler()
+{
+	Stop();
+}
+
+void PoseSampler::Start(uint32_t referenceID, uint32_t targetID, double rate, protocol::PoseCaptureRing *capture, TraceRecorder *recorder)
+{
+	Stop();
+
+	this->capture = capture;
+	this->recorder = recorder;
+	this->referenceID = referenceID;
+	this->targetID = targetID;
+	interval = 1.0 / rate;
+	dropped = 0;
+	busyNanoseconds = 0;
+	queue.Clear();
+	targetTransform.Store(protocol::DeviceTransform());
+
+	// The default timer resolution of ~15 ms is far too coarse for sampling at hundreds of Hz.
+	timeBeginPeriod(1);
+
+	running = true;
+	thread = std::thread(capture ? &PoseSampler::RunCapture : &PoseSampler::Run, this);
+}
+
+void PoseSampler::Stop()
+{
+	if (!running)
+		return;
+
+	running = false;
+	thread.join();
+	timeEndPeriod(1);
+}
+
+void PoseSampler::Queue(const PosePair &pair)
+{
+	if (recorder)
+		recorder->Record(pair);
+
+	if (!queue.Push(pair))
+		dropped++;
+}
+
+double PoseSampler::Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void PoseSampler::Run()
+{
+	vr::TrackedDevicePose_t poses[vr::k_unMaxTrackedDeviceCount];
+	uint32_t poseCount = std::max<uint32_t>(referenceID, targetID) + 1;
+
+	auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+	auto next = std::chrono::steady_clock::now();
+
+	while (running)
+	{
+		auto start = std::chrono::steady_clock::now();
+		vr::VRSystem()->GetDeviceToAbsoluteTrackingPose(vr::TrackingUniverseRawAndUncalibrated, 0.0f, poses, poseCount);
+
+		PosePair pair;
+		pair.time = Now();
+		pair.reference = poses[referenceID];
+		pair.target = poses[targetID];
+		Queue(pair);
+
+		auto now = std::chrono::steady_clock::now();
+		busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+
+		next += period;
+		if (next < now)
+			next = now; // Fell behind, don't try to catch up with a burst of samples.
+
+		std::this_thread::sleep_until(next);
+	}
+}
+
+// Captured poses further apart than this aren't paired as taken at the same time. The reference is
+// brought to the target's time with its velocity, which is only good for a few milliseconds, and
+// tracked devices report poses at 250 Hz and more.
+static const double MaxPairSkew = 0.005;
+
+static Eigen::Quaterniond Quat(const vr::HmdQuaternion_t &q)
+{
+	return Eigen::Quaterniond(q.w, q.x, q.y, q.z);
+}
+
+// The device's pose in the raw universe, as GetDeviceToAbsoluteTrackingPose would return it.
+static vr::TrackedDevicePose_t TrackedPose(const protocol::CapturedPose &captured)
+{
+	Eigen::Quaterniond worldFromDriver = Quat(captured.qWorldFromDriverRotation);
+	Eigen::Quaterniond driverFromDevice = Quat(captured.qRotation);
+	Eigen::Quaterniond deviceFromHead = Quat(captured.qDriverFromHeadRotation);
+	Eigen::Map<const Eigen::Vector3d> worldTranslation(captured.vecWorldFromDriverTranslation);
+	Eigen::Map<const Eigen::Vector3d> position(captured.vecPosition);
+	Eigen::Map<const Eigen::Vector3d> headTranslation(captured.vecDriverFromHeadTranslation);
+	Eigen::Map<const Eigen::Vector3d> velocity(captured.vecVelocity);
+	Eigen::Map<const Eigen::Vector3d> angularVelocity(captured.vecAngularVelocity);
+
+	Eigen::Matrix3d rot = (worldFromDriver * driverFromDevice * deviceFromHead).toRotationMatrix();
+	Eigen::Vector3d headOffset = driverFromDevice * headTranslation;
+	Eigen::Vector3d trans = worldFromDriver * (headOffset + position) + worldTranslation;
+
+	// The head offset swings around with the device's rotation.
+	Eigen::Vector3d worldVelocity = worldFromDriver * (velocity + angularVelocity.cross(headOffset));
+	Eigen::Vector3d worldAngularVelocity = worldFromDriver * angularVelocity;
+
+	vr::TrackedDevicePose_t pose = {};
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			pose.mDeviceToAbsoluteTracking.m[i][j] = (float) rot(i, j);
+		pose.mDeviceToAbsoluteTracking.m[i][3] = (float) trans(i);
+		pose.vVelocity.v[i] = (float) worldVelocity(i);
+		pose.vAngularVelocity.v[i] = (float) worldAngularVelocity(i);
+	}
+	pose.eTrackingResult = captured.result;
+	pose.bPoseIsValid = captured.poseIsValid;
+	pose.bDeviceIsConnected = captured.deviceIsConnected;
+	return pose;
+}
+
+// The pose moved on by the given number of seconds at its current linear and angular velocity.
+static vr::TrackedDevicePose_t Extrapolate(const vr::TrackedDevicePose_t &pose, double seconds)
+{
+	Eigen::Matrix3d rot;
+	Eigen::Vector3d trans, velocity, angularVelocity;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			rot(i, j) = pose.mDeviceToAbsoluteTracking.m[i][j];
+		trans(i) = pose.mDeviceToAbsoluteTracking.m[i][3];
+		velocity(i) = pose.vVelocity.v[i];
+		angularVelocity(i) = pose.vAngularVelocity.v[i];
+	}
+
+	double angle = angularVelocity.norm() * seconds;
+	if (angle != 0.0)
+		rot = Eigen::AngleAxisd(angle, angularVelocity.normalized()) * rot;
+	trans += velocity * seconds;
+
+	vr::TrackedDevicePose_t moved = pose;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			moved.mDeviceToAbsoluteTracking.m[i][j] = (float) rot(i, j);
+		moved.mDeviceToAbsoluteTracking.m[i][3] = (float) trans(i);
+	}
+	return moved;
+}
+
+// Offsets a captured pose the way the driver's pose hook does.
+static void ApplyTransform(protocol::CapturedPose &captured, const protocol::DeviceTransform &tf)
+{
+	Eigen::Quaterniond rotation = Quat(tf.rotation);
+	Eigen::Quaterniond worldFromDriver = rotation * Quat(captured.qWorldFromDriverRotation);
+	captured.qWorldFromDriverRotation = { worldFromDriver.w(), worldFromDriver.x(), worldFromDriver.y(), worldFromDriver.z() };
+
+	Eigen::Map<Eigen::Vector3d> position(captured.vecPosition);
+	position *= tf.scale;
+
+	Eigen::Map<Eigen::Vector3d> worldTranslation(captured.vecWorldFromDriverTranslation);
+	worldTranslation = rotation * worldTranslation + Eigen::Vector3d(tf.translation.v[0], tf.translation.v[1], tf.translation.v[2]);
+}
+
+void PoseSampler::RunCapture()
+{
+	capture->Clear();
+	capture->devices = (1ull << referenceID) | (1ull << targetID);
+
+	PosePair pair;
+	vr::TrackedDevicePose_t reference;
+	double referenceTime = -1.0;
+
+	auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+
+	while (running)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		protocol::CapturedPose captured;
+		while (capture->Pop(captured))
+		{
+			double time = captured.timestamp * 1e-9 + captured.poseTimeOffset;
+
+			if (captured.openVRID == referenceID)
+			{
+				reference = TrackedPose(captured);
+				referenceTime = time;
+				continue;
+			}
+
+			if (captured.openVRID != targetID || referenceTime < 0.0)
+				continue;
+
+			auto tf = targetTransform.Load();
+			if (tf.enabled)
+				ApplyTransform(captured, tf);
+
+			pair.time = time;
+			pair.target = TrackedPose(captured);
+
+			// The devices report independently, so the reference pose is moved to when the target's
+			// was taken. At 180 degrees per second, 10 ms between them would be almost 2 degrees.
+			pair.reference = Extrapolate(reference, time - referenceTime);
+
+			// A reference that stopped reporting counts as lost tracking, like an invalid pose.
+			if (std::abs(time - referenceTime) > MaxPairSkew)
+				pair.reference.bPoseIsValid = false;
+
+			Queue(pair);
+		}
+
+		busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+		// The ring holds seconds of poses, so draining it at the sampling rate loses nothing.
+		std::this_thread::sleep_for(period);
+	}
+
+	capture->devices = 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// Ahead of PoseCapture.h, which would otherwise pull in the driver's OpenVR header.
+#include <openvr.h>
+
+#include "../PoseCapture.h"
+#include "../SharedTransforms.h"
+#include "RingBuffer.h"
+
+#include <atomic>
+#include <thread>
+
+class TraceRecorder;
+
+// Polls the poses of the reference and target devices on a dedicated thread at a fixed rate,
+// independent of how often the UI loop runs, and queues them with the time they were taken.
+//
+// Given the driver's pose capture ring, it instead drains the raw poses the driver captured at
+// the devices' own rate, and queues a pair for every target pose, with the latest reference pose
+// extrapolated to the time the target's was taken. Target poses are captured before the driver
+// applies the target's transform, so the sampler applies the one set with SetTargetTransform
+// itself, and the pairs match what polling would have returned.
+//
+// Given a trace recorder, every pair is also recorded as it is taken, whether or not the consumer
+// ends up using it.
+class PoseSampler
+{
+public:
+	struct PosePair
+	{
+		double time;
+		vr::TrackedDevicePose_t reference, target;
+	};
+
+	~PoseSampler();
+
+	void Start(uint32_t referenceID, uint32_t targetID, double rate, protocol::PoseCaptureRing *capture = nullptr, TraceRecorder *recorder = nullptr);
+	void Stop();
+
+	// The transform the driver applies to the target, for captured poses. Start resets it to none.
+	void SetTargetTransform(const protocol::DeviceTransform &transform) { targetTransform.Store(transform); }
+
+	// Consumer side of the queue, to be called from a single thread.
+	bool Pop(PosePair &pair) { return queue.Pop(pair); }
+	void Discard() { queue.Clear(); }
+
+	// Number of pose pairs dropped because the consumer fell too far behind.
+	size_t Dropped() const { return dropped; }
+
+	// Time the sampling thread has spent working rather than sleeping since Start, in seconds.
+	double BusyTime() const { return busyNanoseconds * 1e-9; }
+
+	// Clock used for PosePair::time, in seconds.
+	static double Now();
+
+private:
+	void Run();
+	void RunCapture();
+	void Queue(const PosePair &pair);
+
+	RingBuffer<PosePair, 1024> queue;
+	std::thread thread;
+	std::atomic<bool> running = { false };
+	std::atomic<size_t> dropped = { 0 };
+	std::atomic<uint64_t> busyNanoseconds = { 0 };
+
+	protocol::PoseCaptureRing *capture = nullptr;
+	TraceRecorder *recorder = nullptr;
+	SeqLock<protocol::DeviceTransform> targetTransform;
+	uint32_t referenceID = 0, targetID = 0;
+	double interval = 0.0;
+};
@@ -0,0 +1,164 @@
+#include "PoseTrace.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static void AppendString(std::string &out, const std::string &str)
+{
+	uint16_t length = (uint16_t) std::min<size_t>(str.size(), UINT16_MAX);
+	out.append((const char *) &length, sizeof length);
+	out.append(str, 0, length);
+}
+
+std::string EncodeTraceHeader(const TraceHeader &header)
+{
+	std::string out(TraceMagic, sizeof TraceMagic);
+	out.append((const char *) &TraceVersion, sizeof TraceVersion);
+
+	AppendString(out, header.referenceSerial);
+	AppendString(out, header.referenceTrackingSystem);
+	AppendString(out, header.targetSerial);
+	AppendString(out, header.targetTrackingSystem);
+	return out;
+}
+
+static std::string ReadString(std::istream &stream)
+{
+	uint16_t length = 0;
+	stream.read((char *) &length, sizeof length);
+
+	std::string str(length, '\0');
+	stream.read(&str[0], length);
+	if (!stream)
+		throw std::runtime_error("truncated trace header");
+
+	return str;
+}
+
+PoseTrace LoadPoseTrace(const std::string &path)
+{
+	std::ifstream stream(path, std::ios::binary);
+	if (!stream)
+		throw std::runtime_error("could not open " + path);
+
+	char magic[sizeof TraceMagic];
+	uint32_t version = 0;
+	stream.read(magic, sizeof magic);
+	stream.read((char *) &version, sizeof version);
+
+	if (!stream || memcmp(magic, TraceMagic, sizeof magic) != 0)
+		throw std::runtime_error(path + " is not a pose trace");
+	if (version != TraceVersion)
+		throw std::runtime_error("unsupported pose trace version " + std::to_string(version));
+
+	PoseTrace trace;
+	trace.header.referenceSerial = ReadString(stream);
+	trace.header.referenceTrackingSystem = ReadString(stream);
+	trace.header.targetSerial = ReadString(stream);
+	trace.header.targetTrackingSystem = ReadString(stream);
+
+	// A partial record at the end is left over from a recording that was cut short, drop it.
+	TraceRecord record;
+	while (stream.read((char *) &record, sizeof record))
+		trace.records.push_back(record);
+
+	return trace;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+ReplayResult ReplayPoseTrace(const PoseTrace &trace, bool robust, size_t sampleCount, ReplaySelection selection)
+{
+	ReplayResult result;
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<Sample> phases[3];
+	SampleSelector selector;
+	bool saturated = false;
+	double lastTaken = -std::numeric_limits<double>::infinity();
+	bool first = true;
+	TracePhase current = TracePhase::Rotation;
+
+	for (auto &record : trace.records)
+	{
+		// Transition records, and phases from a newer version of this enum.
+		if (record.phase > TracePhase::Joint)
+			continue;
+		if (!record.reference.poseIsValid || !record.target.poseIsValid)
+			continue;
+
+		// Selection starts over with each phase, as it does in CalibrationTick.
+		if (first || record.phase != current)
+		{
+			selector.Clear();
+			saturated = false;
+			lastTaken = -std::numeric_limits<double>::infinity();
+			current = record.phase;
+			first = false;
+		}
+
+		auto &samples = phases[(int) record.phase];
+		if (samples.size() >= sampleCount || saturated)
+			continue;
+
+		Sample sample(Pose(record.reference.deviceToAbsoluteTracking), Pose(record.target.deviceToAbsoluteTracking));
+		if (selection == ReplaySelection::FixedInterval)
+		{
+			if (record.time - lastTaken >= FixedSampleInterval)
+			{
+				samples.push_back(sample);
+				lastTaken = record.time;
+			}
+			continue;
+		}
+
+		if (selector.Accept(sample, record.time))
+			samples.push_back(sample);
+		saturated = selector.Saturated(record.time);
+	}
+
+	result.selectionTime = Seconds(start);
+	std::atomic<bool> cancelled = { false };
+
+	auto &joint = phases[(int) TracePhase::Joint];
+	if (!joint.empty())
+	{
+		start = std::chrono::steady_clock::now();
+		JointAccumulator accumulator;
+		accumulator.AddSamples(joint.data(), joint.size());
+		result.sampleCount = joint.size();
+
+		if (accumulator.CanSolve())
+			result.estimate = robust ? SolveRobust(accumulator, joint, cancelled, result.inlierRatio) : accumulator.Solve();
+		result.jointTime = Seconds(start);
+		return result;
+	}
+
+	auto &rotationSamples = phases[(int) TracePhase::Rotation];
+	auto &translationSamples = phases[(int) TracePhase::Translation];
+	result.sampleCount = rotationSamples.size() + translationSamples.size();
+
+	double rotationInliers = 1.0, translationInliers = 1.0;
+
+	start = std::chrono::steady_clock::now();
+	RotationAccumulator rotation;
+	rotation.AddSamples(rotationSamples.data(), rotationSamples.size());
+	if (rotation.CanSolve())
+		result.estimate.rot = robust ? SolveRobust(rotation, rotationSamples, cancelled, rotationInliers) : rotation.Solve();
+	result.rotationTime = Seconds(start);
+
+	start = std::chrono::steady_clock::now();
+	TranslationAccumulator translation;
+	translation.AddSamples(translationSamples.data(), translationSamples.size());
+	if (translation.CanSolve())
+		result.estimate.trans = robust ? SolveRobust(translation, translationSamples, cancelled, translationInliers) : translation.Solve();
+	result.translationTime = Seconds(start);
+
+	result.inlierRatio = std::min<double>(rotationInliers, translationInliers);
+	return result;
+}
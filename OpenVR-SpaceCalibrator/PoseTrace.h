@@ -0,0 +1,97 @@
+#pragma once
+
+// Recorded calibration sessions, for replaying them through the solvers offline. Like
+// CalibrationMath, this has no dependency on OpenVR or Windows.
+//
+// A trace file is a header naming the devices, followed by fixed size records until the end of the
+// file, all in native (little endian) byte order:
+//
+//   char magic[8] = "SCTRACE", uint32_t version
+//   reference serial, reference tracking system, target serial, target tracking system,
+//     each as a uint16_t length followed by that many bytes
+//   TraceRecord, repeated
+
+#include "CalibrationMath.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static const char TraceMagic[8] = "SCTRACE";
+static const uint32_t TraceVersion = 2;
+
+// Which solver the samples of a record were collected for. In the translation phase, the target
+// pose already has the calibrated rotation applied by the driver. Transition records were taken
+// while the driver was switching the target over to a new transform, and a live calibration
+// discards them.
+enum class TracePhase : uint8_t
+{
+	Rotation,
+	Translation,
+	Joint,
+	Transition,
+};
+
+#pragma pack(push, 1)
+// Everything vr::TrackedDevicePose_t holds, with the tracking result as its enum value.
+struct TraceDevicePose
+{
+	float deviceToAbsoluteTracking[3][4];
+	float velocity[3];
+	float angularVelocity[3];
+	int32_t trackingResult;
+	uint8_t poseIsValid, deviceIsConnected;
+};
+
+struct TraceRecord
+{
+	double time;
+	TracePhase phase;
+	TraceDevicePose reference, target;
+};
+#pragma pack(pop)
+
+struct TraceHeader
+{
+	std::string referenceSerial, referenceTrackingSystem;
+	std::string targetSerial, targetTrackingSystem;
+};
+
+struct PoseTrace
+{
+	TraceHeader header;
+	std::vector<TraceRecord> records;
+};
+
+// The bytes a trace file starts with.
+std::string EncodeTraceHeader(const TraceHeader &header);
+
+// Throws std::runtime_error if the file can't be read or isn't a trace.
+PoseTrace LoadPoseTrace(const std::string &path);
+
+struct ReplayResult
+{
+	JointEstimate estimate;
+	size_t sampleCount = 0;
+	double inlierRatio = 1.0;
+
+	// Wall clock seconds spent picking samples, and in each solver including its accumulation.
+	double selectionTime = 0.0, rotationTime = 0.0, translationTime = 0.0, jointTime = 0.0;
+};
+
+// How a replay picks samples out of the records. Coverage runs them through the SampleSelector
+// like a live calibration, ending a phase when its coverage is saturated. FixedInterval takes one
+// every FixedSampleInterval seconds, as calibrations did before the selector, for comparison.
+enum class ReplaySelection
+{
+	Coverage,
+	FixedInterval,
+};
+
+static const double FixedSampleInterval = 0.05;
+
+// Runs the recorded pose pairs through the solvers the way a live calibration does, which stops
+// taking samples for a phase at sampleCount of them at the most (see
+// CalibrationContext::SampleCount). Records with an invalid pose or taken in a transition are
+// skipped.
+ReplayResult ReplayPoseTrace(const PoseTrace &trace, bool robust, size_t sampleCount, ReplaySelection selection = ReplaySelection::Coverage);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer queue. Push and Pop never block or allocate; Push fails
+// when the queue is full, and Pop fails when it is empty.
+template<class T, size_t Capacity>
+class RingBuffer
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+public:
+	// Producer side.
+	bool Push(const T &item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == Capacity)
+			return false;
+
+		items[h & (Capacity - 1)] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side.
+	bool Pop(T &item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+			return false;
+
+		item = items[t & (Capacity - 1)];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, drops everything pushed so far.
+	void Clear()
+	{
+		tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+private:
+	// Keep the indices on separate cache lines so the two threads don't contend.
+	alignas(64) std::atomic<size_t> head = { 0 };
+	alignas(64) std::atomic<size_t> tail = { 0 };
+	T items[Capacity];
+};
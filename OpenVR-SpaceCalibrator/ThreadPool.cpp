@@ -0,0 +1,76 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threadCount) : nextTile(0)
+{
+	for (unsigned i = 1; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+
+	for (auto &worker : workers)
+		worker.join();
+}
+
+void ThreadPool::ParallelFor(size_t tileCount, const std::function<void(size_t)> &fn)
+{
+	if (workers.empty() || tileCount <= 1)
+	{
+		for (size_t tile = 0; tile < tileCount; tile++)
+			fn(tile);
+		return;
+	}
+
+	std::lock_guard<std::mutex> caller(callerMutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		jobTileCount = tileCount;
+		nextTile = 0;
+		generation++;
+	}
+	wake.notify_all();
+
+	RunTiles();
+
+	// Workers keep a pointer to the job while they hold a tile, so wait for all of them to let go
+	// before returning and invalidating it.
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return activeWorkers == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::RunTiles()
+{
+	for (size_t tile = nextTile++; tile < jobTileCount; tile = nextTile++)
+		(*job)(tile);
+}
+
+void ThreadPool::WorkerLoop()
+{
+	uint64_t seenGeneration = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		wake.wait(lock, [&] { return stop || (job && generation != seenGeneration); });
+		if (stop)
+			return;
+
+		seenGeneration = generation;
+		activeWorkers++;
+		lock.unlock();
+
+		RunTiles();
+
+		lock.lock();
+		if (--activeWorkers == 0)
+			finished.notify_all();
+	}
+}
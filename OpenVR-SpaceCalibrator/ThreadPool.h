@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that split independent work into tiles.
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	// Runs fn(tile) for every tile in [0, tileCount), using the calling thread as one of the workers,
+	// and returns once all tiles are finished. Tiles may run in any order, so callers that need
+	// deterministic results write into per-tile storage and reduce it in tile order afterwards.
+	// Concurrent callers are serialized.
+	void ParallelFor(size_t tileCount, const std::function<void(size_t)> &fn);
+
+	unsigned ThreadCount() const { return (unsigned) workers.size() + 1; }
+
+private:
+	void WorkerLoop();
+	void RunTiles();
+
+	std::vector<std::thread> workers;
+
+	std::mutex callerMutex;
+	std::mutex mutex;
+	std::condition_variable wake, finished;
+
+	const std::function<void(size_t)> *job = nullptr;
+	size_t jobTileCount = 0;
+	uint64_t generation = 0;
+	unsigned activeWorkers = 0;
+	bool stop = false;
+
+	std::atomic<size_t> nextTile;
+};
@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "TraceRecorder.h"
+
+#include <chrono>
+#include <cstring>
+
+TraceRecorder::~TraceRecorder()
+{
+	Stop();
+}
+
+bool TraceRecorder::Start(const std::string &path, const TraceHeader &header)
+{
+	Stop();
+
+	if (fopen_s(&file, path.c_str(), "wb") != 0 || file == nullptr)
+		return false;
+
+	// Writes go out through our own buffer.
+	setvbuf(file, nullptr, _IONBF, 0);
+
+	auto encoded = EncodeTraceHeader(header);
+	fwrite(encoded.data(), 1, encoded.size(), file);
+
+	queue.Clear();
+	buffered = 0;
+	dropped = 0;
+	running = true;
+	thread = std::thread(&TraceRecorder::Run, this);
+	return true;
+}
+
+void TraceRecorder::Stop()
+{
+	if (!running)
+		return;
+
+	running = false;
+	thread.join();
+}
+
+static void CopyPose(TraceDevicePose &out, const vr::TrackedDevicePose_t &pose)
+{
+	memcpy(out.deviceToAbsoluteTracking, pose.mDeviceToAbsoluteTracking.m, sizeof out.deviceToAbsoluteTracking);
+	memcpy(out.velocity, pose.vVelocity.v, sizeof out.velocity);
+	memcpy(out.angularVelocity, pose.vAngularVelocity.v, sizeof out.angularVelocity);
+	out.trackingResult = pose.eTrackingResult;
+	out.poseIsValid = pose.bPoseIsValid;
+	out.deviceIsConnected = pose.bDeviceIsConnected;
+}
+
+void TraceRecorder::Record(const PoseSampler::PosePair &pair)
+{
+	TraceRecord record;
+	record.time = pair.time;
+	record.phase = phase.load(std::memory_order_relaxed);
+	CopyPose(record.reference, pair.reference);
+	CopyPose(record.target, pair.target);
+
+	if (!queue.Push(record))
+		dropped++;
+}
+
+void TraceRecorder::Run()
+{
+	auto lastFlush = std::chrono::steady_clock::now();
+	TraceRecord record;
+
+	while (true)
+	{
+		// Checked before draining, so everything recorded before Stop() makes it into the file.
+		bool stopping = !running;
+
+		while (queue.Pop(record))
+		{
+			if (buffered + sizeof record > sizeof buffer)
+				Flush();
+
+			memcpy(buffer + buffered, &record, sizeof record);
+			buffered += sizeof record;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (stopping || now - lastFlush >= std::chrono::milliseconds(250))
+		{
+			Flush();
+			lastFlush = now;
+		}
+
+		if (stopping)
+			break;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	fclose(file);
+	file = nullptr;
+}
+
+void TraceRecorder::Flush()
+{
+	if (buffered > 0)
+		fwrite(buffer, 1, buffered, file);
+
+	buffered = 0;
+}
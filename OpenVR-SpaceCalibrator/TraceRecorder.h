@@ -0,0 +1,50 @@
+#pragma once
+
+#include "PoseSampler.h"
+#include "PoseTrace.h"
+#include "RingBuffer.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// Streams the pose pairs of a calibration session to a trace file, see PoseTrace.h.
+//
+// Record() only copies the pair into a fixed size queue, so it never blocks or allocates. A writer
+// thread drains the queue into a fixed buffer and writes it out in large chunks, at least every
+// quarter second so little is lost if the process dies mid-session.
+class TraceRecorder
+{
+public:
+	~TraceRecorder();
+
+	// Creates the file and writes its header. Returns false if the file can't be created.
+	bool Start(const std::string &path, const TraceHeader &header);
+
+	// Writes out everything recorded so far and closes the file.
+	void Stop();
+
+	bool Recording() const { return running; }
+
+	// Producer side, to be called from a single thread. Records are tagged with the phase last set.
+	void Record(const PoseSampler::PosePair &pair);
+	void SetPhase(TracePhase phase) { this->phase = phase; }
+
+	// Number of pose pairs dropped because the writer fell too far behind.
+	size_t Dropped() const { return dropped; }
+
+private:
+	void Run();
+	void Flush();
+
+	RingBuffer<TraceRecord, 4096> queue;
+	std::thread thread;
+	std::atomic<bool> running = { false };
+	std::atomic<size_t> dropped = { 0 };
+	std::atomic<TracePhase> phase = { TracePhase::Rotation };
+
+	FILE *file = nullptr;
+	char buffer[600 * sizeof(TraceRecord)];
+	size_t buffered = 0;
+};
@@ -0,0 +1,93 @@
+#ifndef _WIN32
+
+#include "UnixSocketClient.h"
+
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+std::unique_ptr<ClientTransport> CreateClientTransport()
+{
+	return std::unique_ptr<ClientTransport>(new UnixSocketClient());
+}
+
+UnixSocketClient::~UnixSocketClient()
+{
+	if (fd >= 0)
+		close(fd);
+}
+
+void UnixSocketClient::Connect()
+{
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, OPENVR_SPACECALIBRATOR_SOCKET_PATH, sizeof addr.sun_path - 1);
+
+	// The socket stays blocking, and every call that must not wait passes MSG_DONTWAIT.
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, (sockaddr *) &addr, sizeof addr) != 0)
+	{
+		throw std::runtime_error("Space Calibrator driver unavailable. Error: " + std::string(strerror(errno)));
+	}
+}
+
+void UnixSocketClient::Write(std::string frame)
+{
+	writes.push_back(std::move(frame));
+	Flush();
+}
+
+void UnixSocketClient::Flush()
+{
+	while (!writes.empty())
+	{
+		auto &frame = writes.front();
+		if (send(fd, frame.data(), frame.size(), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+
+			throw std::runtime_error("Error writing IPC request. Error: " + std::string(strerror(errno)));
+		}
+		writes.pop_front();
+	}
+}
+
+bool UnixSocketClient::Read(const char *&data, size_t &size, bool wait)
+{
+	while (true)
+	{
+		Flush();
+
+		ssize_t received = recv(fd, buffer, sizeof buffer, MSG_DONTWAIT | MSG_TRUNC);
+		if (received > 0)
+		{
+			if ((size_t) received > sizeof buffer)
+				throw std::runtime_error("IPC response of " + std::to_string(received) + " bytes is too large");
+
+			data = buffer;
+			size = received;
+			return true;
+		}
+
+		if (received == 0)
+			throw std::runtime_error("Space Calibrator driver closed the connection");
+
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			throw std::runtime_error("Error reading IPC response. Error: " + std::string(strerror(errno)));
+
+		if (!wait)
+			return false;
+
+		// Requests still queued may be what the response is waiting on.
+		pollfd pfd = { fd, (short) (POLLIN | (writes.empty() ? 0 : POLLOUT)), 0 };
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			throw std::runtime_error("Error waiting for IPC response. Error: " + std::string(strerror(errno)));
+	}
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include "ClientTransport.h"
+#include "../Protocol.h"
+
+#include <deque>
+
+// Unix domain socket client for platforms without named pipes, see UnixSocketServer in the
+// driver. Frames the socket can't take right away are queued and sent on later calls.
+class UnixSocketClient : public ClientTransport
+{
+public:
+	~UnixSocketClient();
+
+	void Connect() override;
+	void Write(std::string frame) override;
+	bool Read(const char *&data, size_t &size, bool wait) override;
+
+private:
+	void Flush();
+
+	int fd = -1;
+	std::deque<std::string> writes;
+	char buffer[protocol::MaxFrameSize];
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include "UserInterface.h"
 #include "Calibration.h"
 #include "Configuration.h"
+#include "DeviceRegistry.h"
 #include "../Version.h"
 
 #include <thread>
@@ -28,7 +29,7 @@ struct VRState
 
 void TextWithWidth(const char *label, const char *text, float width);
 
-VRState LoadVRState();
+const VRState &LoadVRState();
 void BuildSystemSelection(const VRState &state);
 void BuildDeviceSelections(const VRState &state);
 void BuildProfileEditor();
@@ -54,7 +55,7 @@ void BuildMainWindow(bool runningInOverlay)
 
 	ImGui::PushStyleColor(ImGuiCol_PlotHistogram, ImGui::GetStyleColorVec4(ImGuiCol_Button));
 
-	auto state = LoadVRState();
+	auto &state = LoadVRState();
 	BuildSystemSelection(state);
 	BuildDeviceSelections(state);
 	BuildMenu(runningInOverlay);
@@ -154,6 +155,36 @@ void BuildMenu(bool runningInOverlay)
 			CalCtx.calibrationSpeed = CalibrationContext::VERY_SLOW;
 
 		ImGui::Columns(1);
+		auto mode = CalCtx.calibrationMode;
+
+		ImGui::Columns(4, NULL, false);
+		ImGui::Text("Calibration Mode");
+
+		ImGui::NextColumn();
+		if (ImGui::RadioButton(" Sequential    ", mode == CalibrationContext::SEQUENTIAL))
+			CalCtx.calibrationMode = CalibrationContext::SEQUENTIAL;
+
+		ImGui::NextColumn();
+		if (ImGui::RadioButton(" Joint         ", mode == CalibrationContext::JOINT))
+			CalCtx.calibrationMode = CalibrationContext::JOINT;
+
+		ImGui::Columns(1);
+		ImGui::Checkbox(" Sample every pose the devices report, captured in the driver", &CalCtx.driverPoseCapture);
+		ImGui::Checkbox(" Keep calibrating while the selected devices are attached to each other", &CalCtx.continuousCalibration);
+		if (CalCtx.continuous.active)
+		{
+			auto &continuous = CalCtx.continuous;
+			ImGui::Text("   %.0f samples, %d updates, %.2f ms/s CPU with sampling, %d pose pairs over budget",
+				continuous.weight, (int) continuous.updates, continuous.cost * 1000.0, (int) continuous.overBudget);
+		}
+		ImGui::Checkbox(" Finish as soon as the calibration has converged, before the full sample count", &CalCtx.adaptiveSampleCount);
+		ImGui::Checkbox(" Reject tracking glitches while calibrating (robust solve)", &CalCtx.robustSolve);
+		ImGui::Checkbox(" Record calibration pose traces to files, for troubleshooting", &CalCtx.recordTrace);
+		if (CalCtx.poseHook.valid)
+		{
+			ImGui::Text("   Driver pose hook on the target: %.0f updates/s, %.2f us per update",
+				CalCtx.poseHook.updatesPerSecond, CalCtx.poseHook.meanMicroseconds);
+		}
 	}
 	else if (CalCtx.state == CalibrationState::Editing)
 	{
@@ -203,6 +234,12 @@ void BuildMenu(bool runningInOverlay)
 		}
 		ImGui::PopStyleColor();
 
+		if ((CalCtx.state == CalibrationState::Rotation || CalCtx.state == CalibrationState::Joint) && CalCtx.estimateValid)
+		{
+			auto &euler = CalCtx.estimatedRotation;
+			ImGui::TextColored(ImColor(0.5f, 0.5f, 0.5f), "Current estimate: yaw=%.2f pitch=%.2f roll=%.2f", euler[1], euler[2], euler[0]);
+		}
+
 		if (CalCtx.state == CalibrationState::None)
 		{
 			ImGui::Text("");
@@ -399,59 +436,54 @@ void BuildDeviceSelections(const VRState &state)
 	}
 }
 
-VRState LoadVRState()
+// Rebuilt from the device registry only when a device changed, so frames make no OpenVR queries.
+const VRState &LoadVRState()
 {
-	VRState state;
-	auto &trackingSystems = state.trackingSystems;
+	static VRState state;
+	static uint64_t generation = 0;
+	static bool loaded = false;
 
-	char buffer[vr::k_unMaxPropertyStringSize];
+	if (loaded && generation == Devices.Generation())
+		return state;
+
+	state = VRState();
+	generation = Devices.Generation();
+	loaded = true;
+
+	auto &trackingSystems = state.trackingSystems;
 
 	for (uint32_t id = 0; id < vr::k_unMaxTrackedDeviceCount; ++id)
 	{
-		vr::ETrackedPropertyError err = vr::TrackedProp_Success;
-		auto deviceClass = vr::VRSystem()->GetTrackedDeviceClass(id);
+		auto &info = Devices.Device(id);
+		auto deviceClass = info.deviceClass;
 		if (deviceClass == vr::TrackedDeviceClass_Invalid)
 			continue;
 
-		if (deviceClass != vr::TrackedDeviceClass_TrackingReference)
+		if (deviceClass != vr::TrackedDeviceClass_TrackingReference && info.hasTrackingSystem)
 		{
-			vr::VRSystem()->GetStringTrackedDeviceProperty(id, vr::Prop_TrackingSystemName_String, buffer, vr::k_unMaxPropertyStringSize, &err);
-
-			if (err == vr::TrackedProp_Success)
+			auto &system = info.trackingSystem;
+			auto existing = std::find(trackingSystems.begin(), trackingSystems.end(), system);
+			if (existing != trackingSystems.end())
 			{
-				std::string system(buffer);
-				auto existing = std::find(trackingSystems.begin(), trackingSystems.end(), system);
-				if (existing != trackingSystems.end())
+				if (deviceClass == vr::TrackedDeviceClass_HMD)
 				{
-					if (deviceClass == vr::TrackedDeviceClass_HMD)
-					{
-						trackingSystems.erase(existing);
-						trackingSystems.insert(trackingSystems.begin(), system);
-					}
+					trackingSystems.erase(existing);
+					trackingSystems.insert(trackingSystems.begin(), system);
 				}
-				else
-				{
-					trackingSystems.push_back(system);
-				}
-
-				VRDevice device;
-				device.id = id;
-				device.deviceClass = deviceClass;
-				device.trackingSystem = system;
-
-				vr::VRSystem()->GetStringTrackedDeviceProperty(id, vr::Prop_ModelNumber_String, buffer, vr::k_unMaxPropertyStringSize, &err);
-				device.model = std::string(buffer);
-
-				vr::VRSystem()->GetStringTrackedDeviceProperty(id, vr::Prop_SerialNumber_String, buffer, vr::k_unMaxPropertyStringSize, &err);
-				device.serial = std::string(buffer);
-
-				device.controllerRole = (vr::ETrackedControllerRole) vr::VRSystem()->GetInt32TrackedDeviceProperty(id, vr::Prop_ControllerRoleHint_Int32, &err);
-				state.devices.push_back(device);
 			}
 			else
 			{
-				printf("failed to get tracking system name for id %d\n", id);
+				trackingSystems.push_back(system);
 			}
+
+			VRDevice device;
+			device.id = id;
+			device.deviceClass = deviceClass;
+			device.trackingSystem = system;
+			device.model = info.model;
+			device.serial = info.serial;
+			device.controllerRole = info.controllerRole;
+			state.devices.push_back(device);
 		}
 	}
 
@@ -1,13 +1,10 @@
 #pragma once
 
 #include "../Protocol.h"
+#include "ServerTransport.h"
 
-#include <thread>
-#include <set>
-#include <mutex>
-
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
+#include <memory>
+#include <string>
 
 class ServerTrackedDeviceProvider;
 
@@ -23,31 +20,9 @@ public:
 private:
 	void HandleRequest(const protocol::Request &request, protocol::Response &response);
 
-	struct PipeInstance
-	{
-		OVERLAPPED overlap; // Used by the API
-		HANDLE pipe;
-		IPCServer *server;
-
-		protocol::Request request;
-		protocol::Response response;
-	};
-
-	PipeInstance *CreatePipeInstance(HANDLE pipe);
-	void ClosePipeInstance(PipeInstance *pipeInst);
-
-	static void RunThread(IPCServer *_this);
-	static BOOL CreateAndConnectInstance(LPOVERLAPPED overlap, HANDLE &pipe);
-	static void WINAPI CompletedReadCallback(DWORD err, DWORD bytesRead, LPOVERLAPPED overlap);
-	static void WINAPI CompletedWriteCallback(DWORD err, DWORD bytesWritten, LPOVERLAPPED overlap);
-
-	std::thread mainThread;
-
-	bool running = false;
-	bool stop = false;
-
-	std::set<PipeInstance *> pipes;
-	HANDLE connectEvent;
+	// Decodes a request frame and encodes the reply. Returns false if the frame is malformed.
+	bool HandleFrame(const char *data, size_t size, std::string &reply);
 
+	std::unique_ptr<ServerTransport> transport;
 	ServerTrackedDeviceProvider *driver;
 };
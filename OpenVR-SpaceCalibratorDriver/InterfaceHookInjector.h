@@ -4,7 +4,5 @@
 
 class ServerTrackedDeviceProvider;
 
-static void DetourTrackedDevicePoseUpdated(vr::IVRServerDriverHost * _this, uint32_t unWhichDevice, const vr::DriverPose_t & newPose, uint32_t unPoseStructSize);
-
 void InjectHooks(ServerTrackedDeviceProvider *driver, vr::IVRDriverContext *pDriverContext);
 void DisableHooks();
\ No newline at end of file
@@ -1,8 +1,42 @@
 #define _CRT_SECURE_NO_DEPRECATE
 #include "Logging.h"
 #include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
 
-FILE *LogFile;
+std::atomic<int> LogMinLevel = { LogInfo };
+
+static FILE *LogFile;
+
+// Lines per statement per second before the rest are counted instead of written.
+static const uint32_t RateLimitBurst = 100;
+
+static const size_t MaxLineLength = 480;
+
+struct LogEntry
+{
+	std::atomic<size_t> sequence;
+	LogLevel level;
+	time_t time;
+	char text[MaxLineLength];
+};
+
+// Bounded multi producer, single consumer queue. Each entry's sequence says whose turn it is: equal
+// to a position when a producer may fill it, one past when the writer may take it out.
+static const size_t QueueSize = 1024;
+static LogEntry Queue[QueueSize];
+static std::atomic<size_t> QueueHead = { 0 };
+static size_t QueueTail = 0;
+static std::atomic<uint32_t> QueueDropped = { 0 };
+
+static std::thread WriterThread;
+static std::atomic<bool> WriterRunning = { false };
+
+// Serializes everything that takes entries out of the queue or writes the file.
+static std::mutex WriteMutex;
 
 void OpenLogFile()
 {
@@ -11,18 +45,169 @@ void OpenLogFile()
 	{
 		LogFile = stderr;
 	}
+
+	for (size_t i = 0; i < QueueSize; i++)
+		Queue[i].sequence.store(i, std::memory_order_relaxed);
 }
 
-tm TimeForLog()
+static bool Push(LogLevel level, time_t time, const char *text)
 {
-	auto now = std::chrono::system_clock::now();
-	auto nowTime = std::chrono::system_clock::to_time_t(now);
-	tm value;
-	auto tm = localtime_s(&value, &nowTime);
-	return value;
+	size_t pos = QueueHead.load(std::memory_order_relaxed);
+	LogEntry *entry;
+
+	while (true)
+	{
+		entry = &Queue[pos % QueueSize];
+		size_t seq = entry->sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+		if (diff == 0)
+		{
+			if (QueueHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = QueueHead.load(std::memory_order_relaxed);
+		}
+	}
+
+	entry->level = level;
+	entry->time = time;
+	snprintf(entry->text, sizeof entry->text, "%s", text);
+	entry->sequence.store(pos + 1, std::memory_order_release);
+	return true;
 }
 
-void LogFlush()
+static void WriteLine(LogLevel level, time_t time, const char *text)
 {
+	static const char *prefixes[] = { "ERROR: ", "WARNING: ", "", "DEBUG: " };
+
+	tm local;
+#ifdef _WIN32
+	localtime_s(&local, &time);
+#else
+	localtime_r(&time, &local);
+#endif
+	fprintf(LogFile, "[%02d:%02d:%02d] %s%s\n", local.tm_hour, local.tm_min, local.tm_sec, prefixes[level], text);
+}
+
+// Writes out every entry that's ready. Called with WriteMutex held.
+static void Drain()
+{
+	bool wrote = false;
+
+	while (true)
+	{
+		LogEntry &entry = Queue[QueueTail % QueueSize];
+		if (entry.sequence.load(std::memory_order_acquire) != QueueTail + 1)
+			break;
+
+		WriteLine(entry.level, entry.time, entry.text);
+		entry.sequence.store(QueueTail + QueueSize, std::memory_order_release);
+		QueueTail++;
+		wrote = true;
+	}
+
+	uint32_t dropped = QueueDropped.exchange(0, std::memory_order_relaxed);
+	if (dropped > 0)
+	{
+		fprintf(LogFile, "(%u log lines dropped, queue full)\n", dropped);
+		wrote = true;
+	}
+
+	if (wrote)
+		fflush(LogFile);
+}
+
+static void RunWriter()
+{
+	while (WriterRunning)
+	{
+		{
+			std::lock_guard<std::mutex> lock(WriteMutex);
+			Drain();
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+}
+
+void StartLogThread()
+{
+	if (WriterRunning.exchange(true))
+		return;
+
+	WriterThread = std::thread(RunWriter);
+}
+
+void StopLogThread()
+{
+	if (!WriterRunning.exchange(false))
+		return;
+
+	WriterThread.join();
+
+	std::lock_guard<std::mutex> lock(WriteMutex);
+	Drain();
+}
+
+static bool AllowByRate(LogRateLimit &limit, uint32_t &suppressed)
+{
+	int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	// Approximate under contention, which only means a few lines more or less in a burst.
+	int64_t window = limit.window.load(std::memory_order_relaxed);
+	if (window != second && limit.window.compare_exchange_strong(window, second, std::memory_order_relaxed))
+		limit.count.store(0, std::memory_order_relaxed);
+
+	if (limit.count.fetch_add(1, std::memory_order_relaxed) < RateLimitBurst)
+	{
+		suppressed = limit.suppressed.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	limit.suppressed.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+void LogMessage(LogLevel level, LogRateLimit &limit, const char *format, ...)
+{
+	if (level > LogMinLevel.load(std::memory_order_relaxed))
+		return;
+
+	uint32_t suppressed = 0;
+	if (!AllowByRate(limit, suppressed))
+		return;
+
+	char text[MaxLineLength];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(text, sizeof text, format, args);
+	va_end(args);
+
+	if (length < 0)
+		return;
+
+	if (suppressed > 0 && (size_t) length < sizeof text)
+		snprintf(text + length, sizeof text - length, " (%u similar lines skipped)", suppressed);
+
+	time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+	if (WriterRunning)
+	{
+		if (!Push(level, now, text))
+			QueueDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	// No writer, so anything still queued goes out first to keep lines in order.
+	std::lock_guard<std::mutex> lock(WriteMutex);
+	Drain();
+	WriteLine(level, now, text);
 	fflush(LogFile);
-}
\ No newline at end of file
+}
@@ -1,22 +1,57 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <cstdio>
-#include <ctime>
 
-extern FILE *LogFile;
+// Log lines are formatted on the calling thread into a fixed size queue, and a writer thread
+// batches them out to space_calibrator_driver.log, so logging from the IPC callbacks or the pose
+// hook never waits on the disk. Lines logged while the writer isn't running, before Init() and
+// after Cleanup(), are written out directly.
+
+enum LogLevel
+{
+	LogError,
+	LogWarning,
+	LogInfo,
+	LogDebug,
+};
+
+// Lines below this level are dropped before they are formatted.
+extern std::atomic<int> LogMinLevel;
+
+// Every LOG statement gets one of these, so a statement that fires in a tight loop writes at most
+// a burst of lines a second and a count of what it skipped.
+struct LogRateLimit
+{
+	std::atomic<int64_t> window = { -1 };
+	std::atomic<uint32_t> count = { 0 };
+	std::atomic<uint32_t> suppressed = { 0 };
+};
 
 void OpenLogFile();
-tm TimeForLog();
-void LogFlush();
+void StartLogThread();
 
-#ifndef LOG
-#define LOG(fmt, ...) do { \
-	tm logNow = TimeForLog(); \
-	fprintf(LogFile, "[%02d:%02d:%02d] " fmt "\n", logNow.tm_hour, logNow.tm_min, logNow.tm_sec, __VA_ARGS__); \
-	LogFlush(); \
+// Stops the writer and writes out everything queued so far.
+void StopLogThread();
+
+void LogMessage(LogLevel level, LogRateLimit &limit, const char *format, ...);
+
+#ifndef LOG_AT
+#define LOG_AT(level, fmt, ...) do { \
+	static LogRateLimit logRateLimit; \
+	LogMessage(level, logRateLimit, fmt, ##__VA_ARGS__); \
 } while (0)
 #endif
 
+#define LOG_ERROR(fmt, ...) LOG_AT(LogError, fmt, ##__VA_ARGS__)
+#define LOG_WARNING(fmt, ...) LOG_AT(LogWarning, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...) LOG_AT(LogDebug, fmt, ##__VA_ARGS__)
+
+#ifndef LOG
+#define LOG(fmt, ...) LOG_AT(LogInfo, fmt, ##__VA_ARGS__)
+#endif
+
 #define TRACE(...) {}
 
 #ifndef TRACE
@@ -0,0 +1,53 @@
+#pragma once
+
+#ifdef _WIN32
+
+#include "ServerTransport.h"
+#include "../Protocol.h"
+
+#include <set>
+#include <thread>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// Overlapped named pipe server. Every client gets its own pipe instance, and all of them are served
+// from one thread through I/O completion routines.
+class NamedPipeServer : public ServerTransport
+{
+public:
+	~NamedPipeServer();
+
+	void Run(FrameHandler handler) override;
+	void Stop() override;
+
+private:
+	struct PipeInstance
+	{
+		OVERLAPPED overlap; // Used by the API
+		HANDLE pipe;
+		NamedPipeServer *server;
+
+		char request[protocol::MaxFrameSize];
+		std::string response;
+	};
+
+	PipeInstance *CreatePipeInstance(HANDLE pipe);
+	void ClosePipeInstance(PipeInstance *pipeInst);
+
+	static void RunThread(NamedPipeServer *_this);
+	static BOOL CreateAndConnectInstance(LPOVERLAPPED overlap, HANDLE &pipe);
+	static void WINAPI CompletedReadCallback(DWORD err, DWORD bytesRead, LPOVERLAPPED overlap);
+	static void WINAPI CompletedWriteCallback(DWORD err, DWORD bytesWritten, LPOVERLAPPED overlap);
+
+	FrameHandler handler;
+	std::thread mainThread;
+
+	bool running = false;
+	bool stop = false;
+
+	std::set<PipeInstance *> pipes;
+	HANDLE connectEvent;
+};
+
+#endif
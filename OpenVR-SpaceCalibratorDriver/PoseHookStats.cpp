@@ -0,0 +1,96 @@
+#include "PoseHookStats.h"
+#include "Logging.h"
+
+#include <cmath>
+
+static const auto LogInterval = std::chrono::seconds(30);
+
+// Upper bound of a histogram bucket in microseconds, infinite for the last one.
+static double BucketLimit(uint32_t bucket)
+{
+	if (bucket + 1 >= protocol::PoseHookHistogramBuckets)
+		return INFINITY;
+
+	return (256ull << bucket) / 1000.0;
+}
+
+// Smallest bucket limit that at least the given fraction of the samples fall under.
+static double Percentile(const uint64_t (&histogram)[protocol::PoseHookHistogramBuckets], uint64_t count, double fraction)
+{
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < protocol::PoseHookHistogramBuckets; i++)
+	{
+		seen += histogram[i];
+		if (seen >= count * fraction)
+			return BucketLimit(i);
+	}
+	return INFINITY;
+}
+
+void PoseHookStats::Record(uint32_t openVRID, Clock::time_point start, Clock::time_point end)
+{
+	if (openVRID >= vr::k_unMaxTrackedDeviceCount)
+		return;
+
+	uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+	uint32_t bucket = 0;
+	while (bucket + 1 < protocol::PoseHookHistogramBuckets && nanos >= (256ull << bucket))
+		bucket++;
+
+	auto &counters = devices[openVRID];
+	counters.updates.fetch_add(1, std::memory_order_relaxed);
+	counters.totalNanoseconds.fetch_add(nanos, std::memory_order_relaxed);
+	counters.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+protocol::PoseHookStats PoseHookStats::Get(uint32_t openVRID) const
+{
+	protocol::PoseHookStats stats = {};
+	if (openVRID >= vr::k_unMaxTrackedDeviceCount)
+		return stats;
+
+	auto &counters = devices[openVRID];
+	stats.updates = counters.updates.load(std::memory_order_relaxed);
+	stats.totalNanoseconds = counters.totalNanoseconds.load(std::memory_order_relaxed);
+	for (uint32_t i = 0; i < protocol::PoseHookHistogramBuckets; i++)
+		stats.histogram[i] = counters.histogram[i].load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+void PoseHookStats::LogPeriodically()
+{
+	auto now = Clock::now();
+	if (now - lastLog < LogInterval)
+		return;
+
+	double seconds = std::chrono::duration<double>(now - lastLog).count();
+	lastLog = now;
+
+	for (uint32_t id = 0; id < vr::k_unMaxTrackedDeviceCount; id++)
+	{
+		auto current = Get(id);
+		auto &previous = logged[id];
+
+		// The counters are read one by one while poses keep coming in, so the histogram can be a
+		// few updates ahead of the count. That's fine for a log line.
+		uint64_t updates = current.updates - previous.updates;
+		if (updates > 0)
+		{
+			uint64_t histogram[protocol::PoseHookHistogramBuckets];
+			for (uint32_t i = 0; i < protocol::PoseHookHistogramBuckets; i++)
+				histogram[i] = current.histogram[i] - previous.histogram[i];
+
+			LOG("Pose hook device %d: %.1f updates/s, mean %.2f us, p50 < %.2f us, p99 < %.2f us",
+				id,
+				updates / seconds,
+				(current.totalNanoseconds - previous.totalNanoseconds) / 1000.0 / updates,
+				Percentile(histogram, updates, 0.5),
+				Percentile(histogram, updates, 0.99)
+			);
+		}
+
+		previous = current;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../Protocol.h"
+
+#include <atomic>
+#include <chrono>
+
+// Per device counters for the TrackedDevicePoseUpdated detours: how many poses went through and
+// how long each took, covering both our transform and SteamVR's original function.
+//
+// Record() is called on SteamVR's pose threads and only does relaxed atomic increments. Each
+// device's counters start on a cache line of their own, so devices updated from different threads
+// don't contend, and the counters stay on in release builds.
+class PoseHookStats
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	void Record(uint32_t openVRID, Clock::time_point start, Clock::time_point end);
+
+	// Totals since load. Invalid IDs read as no updates.
+	protocol::PoseHookStats Get(uint32_t openVRID) const;
+
+	// Writes the rates and latencies since the last call to the log, at most every LogInterval.
+	void LogPeriodically();
+
+private:
+	struct alignas(64) Counters
+	{
+		std::atomic<uint64_t> updates = { 0 };
+		std::atomic<uint64_t> totalNanoseconds = { 0 };
+		std::atomic<uint64_t> histogram[protocol::PoseHookHistogramBuckets] = {};
+	};
+
+	Counters devices[vr::k_unMaxTrackedDeviceCount];
+
+	// Only touched by LogPeriodically, on the driver's main thread.
+	protocol::PoseHookStats logged[vr::k_unMaxTrackedDeviceCount] = {};
+	Clock::time_point lastLog = Clock::now();
+};
@@ -2,12 +2,21 @@
 #include "Logging.h"
 #include "InterfaceHookInjector.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
 vr::EVRInitError ServerTrackedDeviceProvider::Init(vr::IVRDriverContext *pDriverContext)
 {
 	TRACE("ServerTrackedDeviceProvider::Init()");
 	VR_INIT_SERVER_DRIVER_CONTEXT(pDriverContext);
+	StartLogThread();
+
+	if (!sharedTransforms.Create())
+		LOG("Could not create shared transform table, transforms will only be taken over IPC");
 
-	memset(transforms, 0, vr::k_unMaxTrackedDeviceCount * sizeof DeviceTransform);
+	if (!poseCapture.Create())
+		LOG("Could not create pose capture ring, raw pose capture is unavailable");
 
 	InjectHooks(this, pDriverContext);
 	server.Run();
@@ -20,9 +29,15 @@ void ServerTrackedDeviceProvider::Cleanup()
 	TRACE("ServerTrackedDeviceProvider::Cleanup()");
 	server.Stop();
 	DisableHooks();
+	StopLogThread();
 	VR_CLEANUP_SERVER_DRIVER_CONTEXT();
 }
 
+void ServerTrackedDeviceProvider::RunFrame()
+{
+	hookStats.LogPeriodically();
+}
+
 inline vr::HmdQuaternion_t operator*(const vr::HmdQuaternion_t &lhs, const vr::HmdQuaternion_t &rhs) {
 	return {
 		(lhs.w * rhs.w) - (lhs.x * rhs.x) - (lhs.y * rhs.y) - (lhs.z * rhs.z),
@@ -32,31 +47,97 @@ inline vr::HmdQuaternion_t operator*(const vr::HmdQuaternion_t &lhs, const vr::H
 	};
 }
 
-inline vr::HmdVector3d_t quaternionRotateVector(const vr::HmdQuaternion_t& quat, const double(&vector)[3]) {
-	vr::HmdQuaternion_t vectorQuat = { 0.0, vector[0], vector[1] , vector[2] };
-	vr::HmdQuaternion_t conjugate = { quat.w, -quat.x, -quat.y, -quat.z };
-	auto rotatedVectorQuat = quat * vectorQuat * conjugate;
-	return { rotatedVectorQuat.x, rotatedVectorQuat.y, rotatedVectorQuat.z };
+void ServerTrackedDeviceProvider::SetDeviceTransform(const protocol::SetDeviceTransform &newTransform)
+{
+	transforms[newTransform.openVRID].Modify([&](protocol::DeviceTransform &tf) {
+		protocol::ApplyTransformUpdate(tf, newTransform);
+	});
 }
 
-void ServerTrackedDeviceProvider::SetDeviceTransform(const protocol::SetDeviceTransform &newTransform)
+// Copies of a shared slot that a client write overlaps before the hook gives up until the next pose.
+static const unsigned SharedLoadAttempts = 16;
+
+static bool Finite(const double *values, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!std::isfinite(values[i]))
+			return false;
+	}
+	return true;
+}
+
+// Whether a transform from the client is safe to apply to poses.
+static bool ValidTransform(const protocol::DeviceTransform &tf)
 {
-	auto &tf = transforms[newTransform.openVRID];
-	tf.enabled = newTransform.enabled;
+	const auto &q = tf.rotation;
+	double norm = q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z;
+
+	return Finite(tf.translation.v, 3) && Finite(&tf.rotationMatrix[0][0], 9)
+		&& std::abs(norm - 1.0) < 1e-3 && std::isfinite(tf.scale) && tf.scale > 0.0;
+}
+
+void ServerTrackedDeviceProvider::SyncSharedTransform(uint32_t openVRID)
+{
+	auto table = sharedTransforms.Get();
+	if (!table)
+		return;
+
+	auto &slot = table->devices[openVRID];
+	auto &synced = syncedSequences[openVRID];
+	if (slot.Sequence() == synced.load(std::memory_order_relaxed))
+		return;
+
+	// Mid-write, or the client died in one. Either way the last good transform stays.
+	protocol::DeviceTransform tf;
+	uint32_t seq;
+	if (!slot.TryLoad(tf, SharedLoadAttempts, &seq))
+		return;
 
-	if (newTransform.updateTranslation)
-		tf.translation = newTransform.translation;
+	synced.store(seq, std::memory_order_relaxed);
 
-	if (newTransform.updateRotation)
-		tf.rotation = newTransform.rotation;
+	if (tf.enabled && !ValidTransform(tf))
+	{
+		LOG("Ignoring invalid transform for device %d from shared memory", openVRID);
+		return;
+	}
 
-	if (newTransform.updateScale)
-		tf.scale = newTransform.scale;
+	transforms[openVRID].Store(tf);
+}
+
+static void CapturePose(protocol::PoseCaptureRing &ring, uint32_t openVRID, const vr::DriverPose_t &pose)
+{
+	protocol::CapturedPose captured;
+	captured.openVRID = openVRID;
+	captured.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	captured.poseTimeOffset = pose.poseTimeOffset;
+	captured.qWorldFromDriverRotation = pose.qWorldFromDriverRotation;
+	std::copy(pose.vecWorldFromDriverTranslation, pose.vecWorldFromDriverTranslation + 3, captured.vecWorldFromDriverTranslation);
+	captured.qDriverFromHeadRotation = pose.qDriverFromHeadRotation;
+	std::copy(pose.vecDriverFromHeadTranslation, pose.vecDriverFromHeadTranslation + 3, captured.vecDriverFromHeadTranslation);
+	captured.qRotation = pose.qRotation;
+	std::copy(pose.vecPosition, pose.vecPosition + 3, captured.vecPosition);
+	std::copy(pose.vecVelocity, pose.vecVelocity + 3, captured.vecVelocity);
+	std::copy(pose.vecAngularVelocity, pose.vecAngularVelocity + 3, captured.vecAngularVelocity);
+	captured.result = pose.result;
+	captured.poseIsValid = pose.poseIsValid;
+	captured.deviceIsConnected = pose.deviceIsConnected;
+	ring.Push(captured);
 }
 
 bool ServerTrackedDeviceProvider::HandleDevicePoseUpdated(uint32_t openVRID, vr::DriverPose_t &pose)
 {
-	auto &tf = transforms[openVRID];
+	if (openVRID >= vr::k_unMaxTrackedDeviceCount)
+		return true;
+
+	// Captured before the offsets below, so calibration sees the device's raw pose.
+	auto capture = poseCapture.Get();
+	if (capture && capture->Capturing(openVRID))
+		CapturePose(*capture, openVRID, pose);
+
+	SyncSharedTransform(openVRID);
+	auto tf = transforms[openVRID].Load();
 	if (tf.enabled)
 	{
 		pose.qWorldFromDriverRotation = tf.rotation * pose.qWorldFromDriverRotation;
@@ -65,10 +146,15 @@ bool ServerTrackedDeviceProvider::HandleDevicePoseUpdated(uint32_t openVRID, vr:
 		pose.vecPosition[1] *= tf.scale;
 		pose.vecPosition[2] *= tf.scale;
 
-		vr::HmdVector3d_t rotatedTranslation = quaternionRotateVector(tf.rotation, pose.vecWorldFromDriverTranslation);
-		pose.vecWorldFromDriverTranslation[0] = rotatedTranslation.v[0] + tf.translation.v[0];
-		pose.vecWorldFromDriverTranslation[1] = rotatedTranslation.v[1] + tf.translation.v[1];
-		pose.vecWorldFromDriverTranslation[2] = rotatedTranslation.v[2] + tf.translation.v[2];
+		const auto &m = tf.rotationMatrix;
+		const double t[3] = {
+			pose.vecWorldFromDriverTranslation[0],
+			pose.vecWorldFromDriverTranslation[1],
+			pose.vecWorldFromDriverTranslation[2]
+		};
+		pose.vecWorldFromDriverTranslation[0] = m[0][0] * t[0] + m[0][1] * t[1] + m[0][2] * t[2] + tf.translation.v[0];
+		pose.vecWorldFromDriverTranslation[1] = m[1][0] * t[0] + m[1][1] * t[1] + m[1][2] * t[2] + tf.translation.v[1];
+		pose.vecWorldFromDriverTranslation[2] = m[2][0] * t[0] + m[2][1] * t[1] + m[2][2] * t[2] + tf.translation.v[2];
 	}
 	return true;
 }
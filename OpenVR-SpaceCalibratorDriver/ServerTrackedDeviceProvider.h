@@ -1,8 +1,12 @@
 #pragma once
 
 #include "IPCServer.h"
+#include "PoseHookStats.h"
+#include "../PoseCapture.h"
+#include "../SharedTransforms.h"
 
 #include <openvr_driver.h>
+#include <atomic>
 
 class ServerTrackedDeviceProvider : public vr::IServerTrackedDeviceProvider
 {
@@ -19,7 +23,7 @@ public:
 	virtual const char * const *GetInterfaceVersions() { return vr::k_InterfaceVersions; }
 
 	/** Allows the driver do to some work in the main loop of the server. */
-	virtual void RunFrame() { }
+	virtual void RunFrame() override;
 
 	/** Returns true if the driver wants to block Standby mode. */
 	virtual bool ShouldBlockStandbyMode() { return false; }
@@ -38,16 +42,28 @@ public:
 	void SetDeviceTransform(const protocol::SetDeviceTransform &newTransform);
 	bool HandleDevicePoseUpdated(uint32_t openVRID, vr::DriverPose_t &pose);
 
+	PoseHookStats &HookStats() { return hookStats; }
+
+	// Whether clients can map the transform table, see SharedTransforms.h.
+	bool SharingTransforms() const { return sharedTransforms.Get() != nullptr; }
+
+	// Whether clients can capture raw poses, see PoseCapture.h.
+	bool CapturingPoses() const { return poseCapture.Get() != nullptr; }
+
 private:
 	IPCServer server;
+	PoseHookStats hookStats;
+
+	// Copies a device's slot of the shared table into transforms if the client changed it.
+	void SyncSharedTransform(uint32_t openVRID);
+
+	// Read by the pose hook on SteamVR's threads. Only ever written from within the driver, by the
+	// IPC thread and by SyncSharedTransform, so readers never wait on another process.
+	SeqLock<protocol::DeviceTransform> transforms[vr::k_unMaxTrackedDeviceCount];
 
-	struct DeviceTransform
-	{
-		bool enabled = false;
-		vr::HmdVector3d_t translation;
-		vr::HmdQuaternion_t rotation;
-		double scale;
-	};
+	// Written by the client, see SharedTransforms.h. The sequence of each slot as last synced.
+	protocol::SharedTransformMapping sharedTransforms;
+	std::atomic<uint32_t> syncedSequences[vr::k_unMaxTrackedDeviceCount] = {};
 
-	DeviceTransform transforms[vr::k_unMaxTrackedDeviceCount];
+	protocol::PoseCaptureMapping poseCapture;
 };
\ No newline at end of file
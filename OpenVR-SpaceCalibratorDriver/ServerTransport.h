@@ -0,0 +1,23 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+// Carries whole protocol frames between the driver and its clients, see Protocol.h. Frames from a
+// client arrive whole and in order, and each gets exactly one reply.
+class ServerTransport
+{
+public:
+	// Turns a request frame into a reply frame. Returning false drops the client.
+	typedef std::function<bool(const char *data, size_t size, std::string &reply)> FrameHandler;
+
+	virtual ~ServerTransport() { }
+
+	// Accepts clients on a thread of its own, and calls the handler on that thread.
+	virtual void Run(FrameHandler handler) = 0;
+	virtual void Stop() = 0;
+};
+
+// Named pipes on Windows, a Unix domain socket elsewhere.
+std::unique_ptr<ServerTransport> CreateServerTransport();
@@ -0,0 +1,224 @@
+#ifndef _WIN32
+
+#include "UnixSocketServer.h"
+#include "Logging.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+std::unique_ptr<ServerTransport> CreateServerTransport()
+{
+	return std::unique_ptr<ServerTransport>(new UnixSocketServer());
+}
+
+UnixSocketServer::~UnixSocketServer()
+{
+	Stop();
+}
+
+void UnixSocketServer::Run(FrameHandler frameHandler)
+{
+	handler = frameHandler;
+
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, OPENVR_SPACECALIBRATOR_SOCKET_PATH, sizeof addr.sun_path - 1);
+
+	// A socket file left behind by a driver that didn't shut down cleanly would fail the bind.
+	unlink(addr.sun_path);
+
+	listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFd < 0 || bind(listenFd, (sockaddr *) &addr, sizeof addr) != 0 || listen(listenFd, 16) != 0)
+	{
+		LOG("Could not listen on %s. Error: %d", addr.sun_path, errno);
+		Stop();
+		return;
+	}
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (epollFd < 0 || stopFd < 0)
+	{
+		LOG("Could not create epoll or event fd. Error: %d", errno);
+		Stop();
+		return;
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = listenFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+	event.data.fd = stopFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event);
+
+	running = true;
+	mainThread = std::thread(&UnixSocketServer::RunThread, this);
+}
+
+void UnixSocketServer::Stop()
+{
+	if (running)
+	{
+		uint64_t one = 1;
+		if (write(stopFd, &one, sizeof one) < 0)
+			LOG("Could not signal IPC thread to stop. Error: %d", errno);
+
+		mainThread.join();
+		running = false;
+	}
+
+	while (!clients.empty())
+		CloseClient(clients.begin()->first);
+
+	for (int *fd : { &listenFd, &epollFd, &stopFd })
+	{
+		if (*fd >= 0)
+			close(*fd);
+		*fd = -1;
+	}
+
+	unlink(OPENVR_SPACECALIBRATOR_SOCKET_PATH);
+}
+
+void UnixSocketServer::RunThread()
+{
+	epoll_event events[32];
+
+	while (true)
+	{
+		int count = epoll_wait(epollFd, events, 32, -1);
+		if (count < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			LOG("epoll_wait failed in RunThread. Error: %d", errno);
+			return;
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			int fd = events[i].data.fd;
+			if (fd == stopFd)
+				return;
+
+			if (fd == listenFd)
+			{
+				Accept();
+				continue;
+			}
+
+			auto it = clients.find(fd);
+			if (it == clients.end())
+				continue;
+
+			bool ok = !(events[i].events & EPOLLERR);
+			if (ok && (events[i].events & EPOLLIN))
+				ok = ReadFrames(fd, it->second);
+			if (ok && (events[i].events & EPOLLOUT))
+				ok = WriteReplies(fd, it->second);
+			if (ok && (events[i].events & EPOLLHUP) && !(events[i].events & EPOLLIN))
+				ok = false;
+
+			if (!ok)
+				CloseClient(fd);
+		}
+	}
+}
+
+void UnixSocketServer::Accept()
+{
+	while (true)
+	{
+		int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				LOG("accept failed. Error: %d", errno);
+			return;
+		}
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+		clients[fd];
+
+		LOG("IPC client connected");
+	}
+}
+
+// Handles every frame the client has sent so far. Returns false if the client should be dropped.
+bool UnixSocketServer::ReadFrames(int fd, Client &client)
+{
+	while (true)
+	{
+		ssize_t size = recv(fd, request, sizeof request, MSG_TRUNC);
+		if (size == 0)
+		{
+			LOG("IPC client disconnecting normally");
+			return false;
+		}
+
+		if (size < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return WriteReplies(fd, client);
+
+			LOG("IPC client disconnecting due to error (via recv), error: %d", errno);
+			return false;
+		}
+
+		if ((size_t) size > sizeof request)
+		{
+			LOG("IPC client disconnecting, frame of %d bytes is too large", (int) size);
+			return false;
+		}
+
+		std::string reply;
+		if (!handler(request, size, reply))
+			return false;
+
+		client.replies.push_back(std::move(reply));
+	}
+}
+
+// Writes queued replies until the socket is full, and asks for a wakeup when it drains if any
+// are left.
+bool UnixSocketServer::WriteReplies(int fd, Client &client)
+{
+	while (!client.replies.empty())
+	{
+		auto &reply = client.replies.front();
+		ssize_t sent = send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+		if (sent < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			LOG("IPC client disconnecting due to error (via send), error: %d", errno);
+			return false;
+		}
+		client.replies.pop_front();
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN | (client.replies.empty() ? 0u : (uint32_t) EPOLLOUT);
+	event.data.fd = fd;
+	epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+	return true;
+}
+
+void UnixSocketServer::CloseClient(int fd)
+{
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	close(fd);
+	clients.erase(fd);
+}
+
+#endif
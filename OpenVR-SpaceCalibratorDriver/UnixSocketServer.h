@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include "ServerTransport.h"
+#include "../Protocol.h"
+
+#include <deque>
+#include <map>
+#include <thread>
+
+// Unix domain socket server for platforms without named pipes. Sequenced packet sockets keep frame
+// boundaries like message mode pipes do, and one thread serves every client through epoll.
+class UnixSocketServer : public ServerTransport
+{
+public:
+	~UnixSocketServer();
+
+	void Run(FrameHandler handler) override;
+	void Stop() override;
+
+private:
+	struct Client
+	{
+		std::deque<std::string> replies;
+	};
+
+	void RunThread();
+	void Accept();
+	bool ReadFrames(int fd, Client &client);
+	bool WriteReplies(int fd, Client &client);
+	void CloseClient(int fd);
+
+	FrameHandler handler;
+	std::thread mainThread;
+	bool running = false;
+
+	int listenFd = -1, epollFd = -1, stopFd = -1;
+	std::map<int, Client> clients;
+	char request[protocol::MaxFrameSize];
+};
+
+#endif
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Protocol.h"
+#include "SharedMemory.h"
+
+#include <atomic>
+
+namespace protocol
+{
+	// A pose as the driver handed it to SteamVR, before any offsets are applied. Unlike a polled
+	// pose, it doesn't include the transform the client set for the device, so a client that
+	// calibrates against a transform it sent, like the translation phase does with the rotation,
+	// has to apply it itself.
+	struct CapturedPose
+	{
+		uint32_t openVRID;
+
+		// Steady clock time of the TrackedDevicePoseUpdated call, in nanoseconds. Both processes
+		// read the same clock, so this compares directly with the client's own timestamps.
+		int64_t timestamp;
+		double poseTimeOffset;
+
+		vr::HmdQuaternion_t qWorldFromDriverRotation;
+		double vecWorldFromDriverTranslation[3];
+		vr::HmdQuaternion_t qDriverFromHeadRotation;
+		double vecDriverFromHeadTranslation[3];
+		vr::HmdQuaternion_t qRotation;
+		double vecPosition[3];
+		double vecVelocity[3];
+		double vecAngularVelocity[3];
+
+		vr::ETrackingResult result;
+		bool poseIsValid;
+		bool deviceIsConnected;
+	};
+
+	// Raw poses of the devices the client asked for, captured by the pose hook at the rate the
+	// devices report them, when the driver offers CapabilityPoseCapture. Capture is off until the
+	// client sets a device mask.
+	//
+	// The queue is the same bounded multi producer, single consumer design as the driver's log
+	// queue, since poses of different devices arrive on different threads: each entry's sequence
+	// is equal to a position when the hook may fill it, and one past when the client may take it.
+	struct PoseCaptureRing
+	{
+		static const uint32_t Version = 2;
+		static const char *Name() { return OPENVR_SPACECALIBRATOR_SHARED_PREFIX "OpenVRSpaceCalibratorPoseCapture"; }
+
+		static const uint64_t Capacity = 4096;
+
+		uint32_t version = Version;
+		uint32_t size = sizeof(PoseCaptureRing);
+
+		// Bit n set to capture device n. Written by the client.
+		std::atomic<uint64_t> devices = { 0 };
+
+		// Poses lost because the client didn't keep up.
+		std::atomic<uint32_t> dropped = { 0 };
+
+		PoseCaptureRing()
+		{
+			for (uint64_t i = 0; i < Capacity; i++)
+				entries[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		bool Capturing(uint32_t openVRID) const
+		{
+			return openVRID < 64 && (devices.load(std::memory_order_relaxed) & (1ull << openVRID)) != 0;
+		}
+
+		// Driver side, from any thread.
+		void Push(const CapturedPose &pose)
+		{
+			uint64_t pos = head.load(std::memory_order_relaxed);
+			Entry *entry;
+
+			while (true)
+			{
+				entry = &entries[pos % Capacity];
+				uint64_t seq = entry->sequence.load(std::memory_order_acquire);
+				int64_t diff = (int64_t) seq - (int64_t) pos;
+
+				if (diff == 0)
+				{
+					if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (diff < 0)
+				{
+					dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				else
+				{
+					pos = head.load(std::memory_order_relaxed);
+				}
+			}
+
+			entry->pose = pose;
+			entry->sequence.store(pos + 1, std::memory_order_release);
+		}
+
+		// Client side, from a single thread.
+		bool Pop(CapturedPose &pose)
+		{
+			Entry &entry = entries[tail % Capacity];
+			if (entry.sequence.load(std::memory_order_acquire) != tail + 1)
+				return false;
+
+			pose = entry.pose;
+			entry.sequence.store(tail + Capacity, std::memory_order_release);
+			tail++;
+			return true;
+		}
+
+		// Client side, takes out everything captured so far.
+		void Clear()
+		{
+			CapturedPose pose;
+			while (Pop(pose));
+		}
+
+	private:
+		struct Entry
+		{
+			std::atomic<uint64_t> sequence;
+			CapturedPose pose;
+		};
+
+		alignas(64) std::atomic<uint64_t> head = { 0 };
+
+		// Only touched by the client, but kept here so a client that reconnects picks up where the
+		// last one stopped.
+		alignas(64) uint64_t tail = 0;
+
+		Entry entries[Capacity];
+	};
+
+	typedef SharedObject<PoseCaptureRing> PoseCaptureMapping;
+}
@@ -1,22 +1,41 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <string>
 
 #ifndef _OPENVR_API
 #include <openvr_driver.h>
 #endif
 
 #define OPENVR_SPACECALIBRATOR_PIPE_NAME "\\\\.\\pipe\\OpenVRSpaceCalibratorDriver"
+#define OPENVR_SPACECALIBRATOR_SOCKET_PATH "/tmp/OpenVRSpaceCalibratorDriver.sock"
 
 namespace protocol
 {
-	const uint32_t Version = 2;
+	// Version of the framing and payload encoding below. Requests added on top of it are
+	// negotiated as capabilities during the handshake instead of bumping this.
+	const uint32_t Version = 5;
+
+	enum Capability : uint32_t
+	{
+		CapabilityTransformBatch = 1 << 0,
+		CapabilityPoseHookStats = 1 << 1,
+		CapabilitySharedTransforms = 1 << 2, // See SharedTransforms.h
+		CapabilityPoseCapture = 1 << 3, // See PoseCapture.h
+	};
+
+	// Everything this build supports.
+	const uint32_t Capabilities = CapabilityTransformBatch | CapabilityPoseHookStats | CapabilitySharedTransforms | CapabilityPoseCapture;
 
 	enum RequestType
 	{
 		RequestInvalid,
 		RequestHandshake,
 		RequestSetDeviceTransform,
+		RequestSetDeviceTransformBatch,
+		RequestGetPoseHookStats,
 	};
 
 	enum ResponseType
@@ -24,11 +43,15 @@ namespace protocol
 		ResponseInvalid,
 		ResponseHandshake,
 		ResponseSuccess,
+		ResponsePoseHookStats,
 	};
 
+	// Sent by the client with what it supports, and answered by the driver with the capabilities
+	// both sides have.
 	struct Protocol
 	{
 		uint32_t version = Version;
+		uint32_t capabilities = Capabilities;
 	};
 
 	struct SetDeviceTransform
@@ -42,6 +65,8 @@ namespace protocol
 		vr::HmdQuaternion_t rotation;
 		double scale;
 
+		SetDeviceTransform() : SetDeviceTransform(0, false) { }
+
 		SetDeviceTransform(uint32_t id, bool enabled) :
 			openVRID(id), enabled(enabled), updateTranslation(false), updateRotation(false), updateScale(false) { }
 
@@ -61,12 +86,39 @@ namespace protocol
 			openVRID(id), enabled(enabled), updateTranslation(true), updateRotation(true), updateScale(true), translation(translation), rotation(rotation), scale(scale) { }
 	};
 
+	// Transforms for several devices, applied in a single round trip.
+	struct SetDeviceTransformBatch
+	{
+		uint32_t count;
+		SetDeviceTransform transforms[vr::k_unMaxTrackedDeviceCount];
+	};
+
+	struct GetPoseHookStats
+	{
+		uint32_t openVRID;
+	};
+
+	// Bucket 0 counts pose hook calls under 256 ns, bucket i those in [128 << i, 256 << i) ns,
+	// and the last bucket everything slower.
+	const uint32_t PoseHookHistogramBuckets = 16;
+
+	// Totals since the driver loaded, for one device.
+	struct PoseHookStats
+	{
+		uint64_t updates;
+		uint64_t totalNanoseconds;
+		uint64_t histogram[PoseHookHistogramBuckets];
+	};
+
 	struct Request
 	{
 		RequestType type;
 
 		union {
+			Protocol protocol;
 			SetDeviceTransform setDeviceTransform;
+			SetDeviceTransformBatch setDeviceTransformBatch;
+			GetPoseHookStats getPoseHookStats;
 		};
 
 		Request() : type(RequestInvalid) { }
@@ -79,9 +131,260 @@ namespace protocol
 
 		union {
 			Protocol protocol;
+			PoseHookStats poseHookStats;
 		};
 
 		Response() : type(ResponseInvalid) { }
 		Response(ResponseType type) : type(type) { }
 	};
-}
\ No newline at end of file
+
+	// On the wire, every request and response is one pipe message: this header followed by length
+	// bytes of payload. Responses carry the sequence number of the request they answer.
+#pragma pack(push, 1)
+	struct FrameHeader
+	{
+		uint16_t type;
+		uint16_t reserved;
+		uint32_t length;
+		uint32_t sequence;
+	};
+#pragma pack(pop)
+
+	// Largest frame either side sends or accepts.
+	const uint32_t MaxFrameSize = 64 * 1024;
+
+	class FrameWriter
+	{
+	public:
+		FrameWriter(uint16_t type, uint32_t sequence) : data(sizeof(FrameHeader), '\0')
+		{
+			FrameHeader header = { type, 0, 0, sequence };
+			memcpy(&data[0], &header, sizeof header);
+		}
+
+		template<typename T> void Put(const T &value)
+		{
+			data.append((const char *) &value, sizeof value);
+		}
+
+		// Fills in the payload length and returns the frame.
+		std::string Finish()
+		{
+			uint32_t length = (uint32_t) (data.size() - sizeof(FrameHeader));
+			memcpy(&data[offsetof(FrameHeader, length)], &length, sizeof length);
+			return data;
+		}
+
+	private:
+		std::string data;
+	};
+
+	// Reads a payload front to back. Reading past the end fails and leaves the value untouched.
+	class FrameReader
+	{
+	public:
+		FrameReader(const char *data, size_t size) : cur(data), end(data + size) { }
+
+		template<typename T> bool Get(T &value)
+		{
+			if ((size_t) (end - cur) < sizeof value)
+				return false;
+
+			memcpy(&value, cur, sizeof value);
+			cur += sizeof value;
+			return true;
+		}
+
+		bool AtEnd() const { return cur == end; }
+
+	private:
+		const char *cur, *end;
+	};
+
+	// Splits a frame into its header and payload. Fails if the lengths don't add up.
+	inline bool ReadFrame(const char *data, size_t size, FrameHeader &header, FrameReader &payload)
+	{
+		if (size < sizeof header)
+			return false;
+
+		memcpy(&header, data, sizeof header);
+		if (header.length != size - sizeof header)
+			return false;
+
+		payload = FrameReader(data + sizeof header, header.length);
+		return true;
+	}
+
+	enum TransformFlags : uint8_t
+	{
+		TransformEnabled = 1 << 0,
+		TransformHasTranslation = 1 << 1,
+		TransformHasRotation = 1 << 2,
+		TransformHasScale = 1 << 3,
+	};
+
+	// Only the parts a transform updates are encoded.
+	inline void PutTransform(FrameWriter &writer, const SetDeviceTransform &tf)
+	{
+		uint8_t flags =
+			(tf.enabled ? TransformEnabled : 0) |
+			(tf.updateTranslation ? TransformHasTranslation : 0) |
+			(tf.updateRotation ? TransformHasRotation : 0) |
+			(tf.updateScale ? TransformHasScale : 0);
+
+		writer.Put(tf.openVRID);
+		writer.Put(flags);
+
+		if (tf.updateTranslation)
+			writer.Put(tf.translation);
+		if (tf.updateRotation)
+			writer.Put(tf.rotation);
+		if (tf.updateScale)
+			writer.Put(tf.scale);
+	}
+
+	inline bool GetTransform(FrameReader &reader, SetDeviceTransform &tf)
+	{
+		uint8_t flags = 0;
+		if (!reader.Get(tf.openVRID) || !reader.Get(flags))
+			return false;
+
+		tf.enabled = (flags & TransformEnabled) != 0;
+		tf.updateTranslation = (flags & TransformHasTranslation) != 0;
+		tf.updateRotation = (flags & TransformHasRotation) != 0;
+		tf.updateScale = (flags & TransformHasScale) != 0;
+
+		if (tf.updateTranslation && !reader.Get(tf.translation))
+			return false;
+		if (tf.updateRotation && !reader.Get(tf.rotation))
+			return false;
+		if (tf.updateScale && !reader.Get(tf.scale))
+			return false;
+
+		return tf.openVRID < vr::k_unMaxTrackedDeviceCount;
+	}
+
+	inline std::string EncodeRequest(const Request &request, uint32_t sequence)
+	{
+		FrameWriter writer((uint16_t) request.type, sequence);
+
+		switch (request.type)
+		{
+		case RequestHandshake:
+			writer.Put(request.protocol.version);
+			writer.Put(request.protocol.capabilities);
+			break;
+
+		case RequestSetDeviceTransform:
+			PutTransform(writer, request.setDeviceTransform);
+			break;
+
+		case RequestSetDeviceTransformBatch:
+			writer.Put(request.setDeviceTransformBatch.count);
+			for (uint32_t i = 0; i < request.setDeviceTransformBatch.count; i++)
+				PutTransform(writer, request.setDeviceTransformBatch.transforms[i]);
+			break;
+
+		case RequestGetPoseHookStats:
+			writer.Put(request.getPoseHookStats.openVRID);
+			break;
+
+		default:
+			break;
+		}
+
+		return writer.Finish();
+	}
+
+	// Fails on malformed frames. Types this build doesn't know decode with an empty payload, so the
+	// driver can answer them with ResponseInvalid instead of dropping the client.
+	inline bool DecodeRequest(const char *data, size_t size, Request &request, uint32_t &sequence)
+	{
+		FrameHeader header;
+		FrameReader reader(nullptr, 0);
+		if (!ReadFrame(data, size, header, reader))
+			return false;
+
+		sequence = header.sequence;
+		request.type = (RequestType) header.type;
+
+		switch (request.type)
+		{
+		case RequestHandshake:
+			request.protocol = Protocol();
+			return reader.Get(request.protocol.version) && reader.Get(request.protocol.capabilities);
+
+		case RequestSetDeviceTransform:
+			request.setDeviceTransform = SetDeviceTransform();
+			return GetTransform(reader, request.setDeviceTransform) && reader.AtEnd();
+
+		case RequestSetDeviceTransformBatch:
+		{
+			auto &batch = request.setDeviceTransformBatch;
+			if (!reader.Get(batch.count) || batch.count > vr::k_unMaxTrackedDeviceCount)
+				return false;
+
+			for (uint32_t i = 0; i < batch.count; i++)
+			{
+				batch.transforms[i] = SetDeviceTransform();
+				if (!GetTransform(reader, batch.transforms[i]))
+					return false;
+			}
+			return reader.AtEnd();
+		}
+
+		case RequestGetPoseHookStats:
+			return reader.Get(request.getPoseHookStats.openVRID) && reader.AtEnd();
+
+		default:
+			return true;
+		}
+	}
+
+	inline std::string EncodeResponse(const Response &response, uint32_t sequence)
+	{
+		FrameWriter writer((uint16_t) response.type, sequence);
+
+		switch (response.type)
+		{
+		case ResponseHandshake:
+			writer.Put(response.protocol.version);
+			writer.Put(response.protocol.capabilities);
+			break;
+
+		case ResponsePoseHookStats:
+			writer.Put(response.poseHookStats);
+			break;
+
+		default:
+			break;
+		}
+
+		return writer.Finish();
+	}
+
+	inline bool DecodeResponse(const char *data, size_t size, Response &response, uint32_t &sequence)
+	{
+		FrameHeader header;
+		FrameReader reader(nullptr, 0);
+		if (!ReadFrame(data, size, header, reader))
+			return false;
+
+		sequence = header.sequence;
+		response.type = (ResponseType) header.type;
+
+		switch (response.type)
+		{
+		case ResponseHandshake:
+			// A newer driver may append fields after these.
+			response.protocol = Protocol();
+			return reader.Get(response.protocol.version) && reader.Get(response.protocol.capabilities);
+
+		case ResponsePoseHookStats:
+			return reader.Get(response.poseHookStats) && reader.AtEnd();
+
+		default:
+			return true;
+		}
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Holds a value that any number of threads read without ever taking a lock or stalling a writer.
+//
+// A writer makes the sequence odd, stores the value and makes it even again; writers that find it
+// odd wait their turn. A reader copies the value out between two reads of the sequence and tries
+// again if a write overlapped, so it always gets a value exactly as it was stored. The value is
+// kept as relaxed atomic words, which compile to plain moves on x64 but keep the overlapping
+// accesses well defined, and which work the same when the lock lives in memory shared between
+// processes.
+//
+// A writer in another process can die halfway through a write and leave the sequence odd for
+// good, so a reader that can't trust every writer uses TryLoad, which gives up after a number of
+// attempts instead of waiting, and writers recover such a lock with Recover.
+template<typename T>
+class SeqLock
+{
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock values are copied bytewise");
+
+	static const size_t WordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+	SeqLock()
+	{
+		for (auto &word : words)
+			word.store(0, std::memory_order_relaxed);
+		Store(T());
+	}
+
+	void Store(const T &value)
+	{
+		Modify([&](T &current) { current = value; });
+	}
+
+	// Reads, changes and writes back the value without another writer getting in between.
+	template<typename F> void Modify(F fn)
+	{
+		uint32_t seq = sequence.load(std::memory_order_relaxed);
+		while ((seq & 1) || !sequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+			seq = sequence.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_release);
+
+		uint64_t buffer[WordCount] = {};
+		for (size_t i = 0; i < WordCount; i++)
+			buffer[i] = words[i].load(std::memory_order_relaxed);
+
+		T value;
+		memcpy(&value, buffer, sizeof value);
+		fn(value);
+		memcpy(buffer, &value, sizeof value);
+
+		for (size_t i = 0; i < WordCount; i++)
+			words[i].store(buffer[i], std::memory_order_relaxed);
+
+		sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	T Load() const
+	{
+		uint64_t buffer[WordCount];
+		uint32_t seq;
+		while (!TryCopy(buffer, seq));
+
+		T value;
+		memcpy(&value, buffer, sizeof value);
+		return value;
+	}
+
+	// Like Load, but returns false if no attempt got past a write. loadedSequence receives the
+	// sequence the value was stored under.
+	bool TryLoad(T &value, unsigned attempts, uint32_t *loadedSequence = nullptr) const
+	{
+		uint64_t buffer[WordCount];
+		uint32_t seq;
+
+		for (unsigned i = 0; i < attempts; i++)
+		{
+			if (TryCopy(buffer, seq))
+			{
+				memcpy(&value, buffer, sizeof value);
+				if (loadedSequence)
+					*loadedSequence = seq;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Changes whenever a write starts or finishes. Odd while one is in progress.
+	uint32_t Sequence() const
+	{
+		return sequence.load(std::memory_order_acquire);
+	}
+
+	// Ends a write its writer abandoned by dying halfway through, so that other writers don't wait
+	// on it forever. The value may be half written, so the caller should store a new one. Only safe
+	// when no writer can be running.
+	void Recover()
+	{
+		uint32_t seq = sequence.load(std::memory_order_relaxed);
+		if (seq & 1)
+			sequence.store(seq + 1, std::memory_order_release);
+	}
+
+private:
+	bool TryCopy(uint64_t (&buffer)[WordCount], uint32_t &seq) const
+	{
+		seq = sequence.load(std::memory_order_acquire);
+
+		for (size_t i = 0; i < WordCount; i++)
+			buffer[i] = words[i].load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return !(seq & 1) && seq == sequence.load(std::memory_order_relaxed);
+	}
+
+	std::atomic<uint32_t> sequence = { 0 };
+	std::atomic<uint64_t> words[WordCount];
+};
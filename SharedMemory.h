@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#define OPENVR_SPACECALIBRATOR_SHARED_PREFIX "Local\\"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define OPENVR_SPACECALIBRATOR_SHARED_PREFIX "/"
+#endif
+
+namespace protocol
+{
+	// A named block of memory mapped into both the driver and the client. The driver creates it and
+	// the client opens it by the same name. Unmapped when closed or destroyed.
+	class SharedMemory
+	{
+	public:
+		SharedMemory() { }
+		SharedMemory(const SharedMemory &) = delete;
+		SharedMemory &operator=(const SharedMemory &) = delete;
+		~SharedMemory() { Close(); }
+
+		bool Create(const char *name, size_t size) { return Map(name, size, true); }
+		bool Open(const char *name, size_t size) { return Map(name, size, false); }
+
+		void Close()
+		{
+#ifdef _WIN32
+			if (view)
+				UnmapViewOfFile(view);
+			if (mapping)
+				CloseHandle(mapping);
+			mapping = nullptr;
+#else
+			if (view)
+				munmap(view, size);
+			if (created)
+				shm_unlink(name);
+			created = false;
+#endif
+			view = nullptr;
+		}
+
+		void *Data() const { return view; }
+
+	private:
+		bool Map(const char *name, size_t size, bool create)
+		{
+			Close();
+			this->name = name;
+			this->size = size;
+#ifdef _WIN32
+			if (create)
+				mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD) size, name);
+			else
+				mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+
+			if (!mapping)
+				return false;
+
+			view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+			int fd = shm_open(name, create ? O_CREAT | O_RDWR : O_RDWR, 0600);
+			if (fd < 0)
+				return false;
+
+			if (create && ftruncate(fd, size) != 0)
+			{
+				close(fd);
+				shm_unlink(name);
+				return false;
+			}
+
+			created = create;
+			view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (view == MAP_FAILED)
+				view = nullptr;
+#endif
+			if (!view)
+			{
+				Close();
+				return false;
+			}
+			return true;
+		}
+
+#ifdef _WIN32
+		HANDLE mapping = nullptr;
+#else
+		bool created = false;
+#endif
+		const char *name = nullptr;
+		size_t size = 0;
+		void *view = nullptr;
+	};
+
+	// Maps a T shared with the other process. The driver creates it, which constructs it in place,
+	// and clients open it. T names its mapping and carries a version and size, which are checked on
+	// open so that a mismatched driver and client don't read each other's layout.
+	template<typename T>
+	class SharedObject
+	{
+	public:
+		bool Create()
+		{
+			if (!memory.Create(T::Name(), sizeof(T)))
+				return false;
+
+			object = new (memory.Data()) T();
+			return true;
+		}
+
+		bool Open()
+		{
+			if (!memory.Open(T::Name(), sizeof(T)))
+				return false;
+
+			object = (T *) memory.Data();
+			if (object->version != T::Version || object->size != sizeof(T))
+			{
+				Close();
+				return false;
+			}
+			return true;
+		}
+
+		void Close()
+		{
+			memory.Close();
+			object = nullptr;
+		}
+
+		T *Get() const { return object; }
+
+	private:
+		SharedMemory memory;
+		T *object = nullptr;
+	};
+}
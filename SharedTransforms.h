@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Protocol.h"
+#include "SeqLock.h"
+#include "SharedMemory.h"
+
+namespace protocol
+{
+	// Offsets applied to a device's poses, as the driver's pose hook reads them.
+	struct DeviceTransform
+	{
+		bool enabled = false;
+		vr::HmdVector3d_t translation;
+		vr::HmdQuaternion_t rotation;
+		double scale;
+
+		// Derived from rotation when it's set, so poses are rotated without quaternion products.
+		double rotationMatrix[3][3];
+	};
+
+	// Applies the parts of a SetDeviceTransform request that it updates.
+	inline void ApplyTransformUpdate(DeviceTransform &tf, const SetDeviceTransform &update)
+	{
+		tf.enabled = update.enabled;
+
+		if (update.updateTranslation)
+			tf.translation = update.translation;
+
+		if (update.updateRotation)
+		{
+			const auto &q = tf.rotation = update.rotation;
+			auto &m = tf.rotationMatrix;
+			m[0][0] = 1 - 2 * (q.y * q.y + q.z * q.z);
+			m[0][1] = 2 * (q.x * q.y - q.w * q.z);
+			m[0][2] = 2 * (q.x * q.z + q.w * q.y);
+			m[1][0] = 2 * (q.x * q.y + q.w * q.z);
+			m[1][1] = 1 - 2 * (q.x * q.x + q.z * q.z);
+			m[1][2] = 2 * (q.y * q.z - q.w * q.x);
+			m[2][0] = 2 * (q.x * q.z - q.w * q.y);
+			m[2][1] = 2 * (q.y * q.z + q.w * q.x);
+			m[2][2] = 1 - 2 * (q.x * q.x + q.y * q.y);
+		}
+
+		if (update.updateScale)
+			tf.scale = update.scale;
+	}
+
+	// Transforms published by the client, mapped into both processes when the driver offers
+	// CapabilitySharedTransforms, so a change is picked up by the next pose without a round trip
+	// over the pipe. Only the client writes it. When a slot's sequence has moved, the pose hook
+	// copies it with a bounded number of attempts, checks it and keeps it in the driver's own table,
+	// so a client that dies mid-write leaves the device on its last good transform instead of
+	// stalling SteamVR's pose threads. There is one client at a time, which recovers the slots the
+	// last one left locked when it connects.
+	struct SharedTransformTable
+	{
+		static const uint32_t Version = 1;
+		static const char *Name() { return OPENVR_SPACECALIBRATOR_SHARED_PREFIX "OpenVRSpaceCalibratorTransforms"; }
+
+		uint32_t version = Version;
+		uint32_t size = sizeof(SharedTransformTable);
+		SeqLock<DeviceTransform> devices[vr::k_unMaxTrackedDeviceCount];
+	};
+
+	typedef SharedObject<SharedTransformTable> SharedTransformMapping;
+}
@@ -0,0 +1,51 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> allocationCount = { 0 };
+static std::atomic<size_t> allocationBytes = { 0 };
+
+AllocationCount Allocations()
+{
+	AllocationCount allocations;
+	allocations.count = allocationCount.load(std::memory_order_relaxed);
+	allocations.bytes = allocationBytes.load(std::memory_order_relaxed);
+	return allocations;
+}
+
+void *operator new(size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocationBytes.fetch_add(size, std::memory_order_relaxed);
+
+	if (void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	std::free(p);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+// Heap allocations made through operator new by every thread of the process, counted by the
+// replacement operators in AllocationCounter.cpp. Link that file into a tool to enable them.
+struct AllocationCount
+{
+	size_t count = 0;
+	size_t bytes = 0;
+};
+
+AllocationCount Allocations();
+
+inline AllocationCount operator-(const AllocationCount &a, const AllocationCount &b)
+{
+	AllocationCount difference;
+	difference.count = a.count - b.count;
+	difference.bytes = a.bytes - b.bytes;
+	return difference;
+}
@@ -0,0 +1,163 @@
+// Measures round trips between the calibrator's IPC client and the driver's server over the Unix
+// socket backend, both in this process, with the server answering from its own thread as it does
+// inside SteamVR.
+//
+//   IPCBench [round trips]
+//
+// Times a handshake, a single device transform and a batch of 16 one at a time, reporting the
+// median and 99th percentile latency and the rate, then sends single transforms pipelined, as
+// SetDeviceTransforms does without batching. Exits with an error if the driver rejects a request
+// or doesn't answer the pose hook stats request the UI sends.
+
+#include "ServerTrackedDeviceProvider.h"
+#include "Logging.h"
+#include "../OpenVR-SpaceCalibrator/IPCClient.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+static const size_t BatchSize = 16;
+
+// Most requests the pipelined run keeps in flight, so the socket buffers never fill.
+static const size_t PipelineDepth = 64;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void PrintHeader()
+{
+	printf("%-18s %10s %10s %12s\n", "request", "p50 us", "p99 us", "msg/s");
+}
+
+// Sends the request the given number of times, waiting for each response before the next.
+static void MeasureRoundTrips(IPCClient &client, const char *name, const protocol::Request &request, size_t count)
+{
+	std::vector<double> latencies;
+	latencies.reserve(count);
+
+	auto begin = Clock::now();
+	for (size_t i = 0; i < count; i++)
+	{
+		auto start = Clock::now();
+		auto response = client.SendBlocking(request);
+		latencies.push_back(Seconds(start) * 1e6);
+
+		if (response.type == protocol::ResponseInvalid)
+			throw std::runtime_error(std::string("The driver rejected a ") + name + " request");
+	}
+	double total = Seconds(begin);
+
+	std::sort(latencies.begin(), latencies.end());
+	printf("%-18s %10.1f %10.1f %12.0f\n", name, latencies[count / 2], latencies[count * 99 / 100], count / total);
+}
+
+static void MeasurePipelined(IPCClient &client, const char *name, const protocol::Request &request, size_t count)
+{
+	size_t completed = 0;
+	bool rejected = false;
+
+	auto begin = Clock::now();
+	for (size_t i = 0; i < count; i++)
+	{
+		client.Send(request, [&](const protocol::Response &response) {
+			completed++;
+			rejected |= response.type == protocol::ResponseInvalid;
+		});
+
+		while (client.InFlight() >= PipelineDepth)
+			client.Poll();
+	}
+
+	while (completed < count)
+		client.Poll();
+	double total = Seconds(begin);
+
+	if (rejected)
+		throw std::runtime_error(std::string("The driver rejected a ") + name + " request");
+
+	printf("%-18s %10s %10s %12.0f\n", name, "-", "-", count / total);
+}
+
+static void CheckPoseHookStats(IPCClient &client)
+{
+	bool answered = false;
+	client.GetPoseHookStats(0, [&](const protocol::PoseHookStats &) {
+		answered = true;
+	});
+
+	while (client.InFlight() > 0)
+		client.Poll();
+
+	if (!answered)
+		throw std::runtime_error("The driver didn't answer the pose hook stats request");
+}
+
+static protocol::SetDeviceTransform ExampleTransform(uint32_t id)
+{
+	return protocol::SetDeviceTransform(id, true, vr::HmdVector3d_t{ { 0.1, 0.2, 0.3 } }, vr::HmdQuaternion_t{ 1, 0, 0, 0 }, 1.0);
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = argc > 1 ? (size_t) atoi(argv[1]) : 20000;
+	if (count == 0)
+	{
+		fprintf(stderr, "usage: IPCBench [round trips]\n");
+		return 2;
+	}
+
+	OpenLogFile();
+	StartLogThread();
+
+	int status = 0;
+	{
+		ServerTrackedDeviceProvider driver;
+		IPCServer server(&driver);
+
+		try
+		{
+			server.Run();
+
+			IPCClient client;
+			client.Connect();
+			CheckPoseHookStats(client);
+
+			protocol::Request handshake(protocol::RequestHandshake);
+			handshake.protocol = protocol::Protocol();
+
+			protocol::Request single(protocol::RequestSetDeviceTransform);
+			single.setDeviceTransform = ExampleTransform(1);
+
+			protocol::Request batch(protocol::RequestSetDeviceTransformBatch);
+			batch.setDeviceTransformBatch.count = BatchSize;
+			for (uint32_t i = 0; i < BatchSize; i++)
+				batch.setDeviceTransformBatch.transforms[i] = ExampleTransform(i);
+
+			printf("%zd round trips per request over the Unix socket\n\n", count);
+			PrintHeader();
+			MeasureRoundTrips(client, "handshake", handshake, count);
+			MeasureRoundTrips(client, "single transform", single, count);
+			if (client.Supports(protocol::CapabilityTransformBatch))
+				MeasureRoundTrips(client, "batch of 16", batch, count);
+			MeasurePipelined(client, "pipelined single", single, count);
+		}
+		catch (const std::exception &e)
+		{
+			fprintf(stderr, "%s\n", e.what());
+			status = 1;
+		}
+
+		server.Stop();
+	}
+
+	StopLogThread();
+	return status;
+}
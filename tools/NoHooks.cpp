@@ -0,0 +1,7 @@
+// Stands in for InterfaceHookInjector.cpp, which needs MinHook and Windows, so the driver's
+// provider links into the tools. Nothing they run is inside SteamVR, so there is nothing to hook.
+
+#include "InterfaceHookInjector.h"
+
+void InjectHooks(ServerTrackedDeviceProvider *, vr::IVRDriverContext *) { }
+void DisableHooks() { }
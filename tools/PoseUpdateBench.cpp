@@ -0,0 +1,170 @@
+// Times the pose hook's work per pose: HandleDevicePoseUpdated, which rotates the driver to world
+// translation with the matrix precomputed in each device's transform, against the quaternion path
+// it replaced, which rotated it with q * v * conj(q) on every pose.
+//
+//   PoseUpdateBench [repetitions]
+//
+// Both run over the same poses, spread across several devices as SteamVR delivers them. The tool
+// exits with an error if they place a pose differently.
+
+#include "ServerTrackedDeviceProvider.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static const uint32_t DeviceCount = 16;
+static const size_t PoseCount = 4096;
+
+// How far apart the two paths may place a pose, in meters.
+static const double AgreementTolerance = 1e-9;
+
+static vr::HmdQuaternion_t operator*(const vr::HmdQuaternion_t &lhs, const vr::HmdQuaternion_t &rhs)
+{
+	return {
+		(lhs.w * rhs.w) - (lhs.x * rhs.x) - (lhs.y * rhs.y) - (lhs.z * rhs.z),
+		(lhs.w * rhs.x) + (lhs.x * rhs.w) + (lhs.y * rhs.z) - (lhs.z * rhs.y),
+		(lhs.w * rhs.y) + (lhs.y * rhs.w) + (lhs.z * rhs.x) - (lhs.x * rhs.z),
+		(lhs.w * rhs.z) + (lhs.z * rhs.w) + (lhs.x * rhs.y) - (lhs.y * rhs.x)
+	};
+}
+
+// HandleDevicePoseUpdated as it was before the rotation matrix.
+static void QuaternionPoseUpdate(SeqLock<protocol::DeviceTransform> &transform, vr::DriverPose_t &pose)
+{
+	auto tf = transform.Load();
+	if (!tf.enabled)
+		return;
+
+	pose.qWorldFromDriverRotation = tf.rotation * pose.qWorldFromDriverRotation;
+
+	pose.vecPosition[0] *= tf.scale;
+	pose.vecPosition[1] *= tf.scale;
+	pose.vecPosition[2] *= tf.scale;
+
+	const auto &t = pose.vecWorldFromDriverTranslation;
+	vr::HmdQuaternion_t vector = { 0.0, t[0], t[1], t[2] };
+	vr::HmdQuaternion_t conjugate = { tf.rotation.w, -tf.rotation.x, -tf.rotation.y, -tf.rotation.z };
+	auto rotated = tf.rotation * vector * conjugate;
+
+	pose.vecWorldFromDriverTranslation[0] = rotated.x + tf.translation.v[0];
+	pose.vecWorldFromDriverTranslation[1] = rotated.y + tf.translation.v[1];
+	pose.vecWorldFromDriverTranslation[2] = rotated.z + tf.translation.v[2];
+}
+
+static vr::HmdQuaternion_t RandomRotation(std::mt19937 &random)
+{
+	std::normal_distribution<double> normal;
+	double w = normal(random), x = normal(random), y = normal(random), z = normal(random);
+	double norm = std::sqrt(w * w + x * x + y * y + z * z);
+	return { w / norm, x / norm, y / norm, z / norm };
+}
+
+static vr::DriverPose_t RandomPose(std::mt19937 &random)
+{
+	std::uniform_real_distribution<double> position(-3.0, 3.0);
+
+	vr::DriverPose_t pose = {};
+	pose.qWorldFromDriverRotation = RandomRotation(random);
+	pose.qDriverFromHeadRotation = { 1, 0, 0, 0 };
+	pose.qRotation = RandomRotation(random);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		pose.vecWorldFromDriverTranslation[axis] = position(random);
+		pose.vecPosition[axis] = position(random);
+	}
+	pose.poseIsValid = true;
+	pose.deviceIsConnected = true;
+	pose.result = vr::TrackingResult_Running_OK;
+	return pose;
+}
+
+// Median nanoseconds per pose. Each pose is updated from a fresh copy, as the hook gets one.
+template<typename Update>
+static double NanosecondsPerPose(const std::vector<vr::DriverPose_t> &poses, int repetitions, double &checksum, Update update)
+{
+	std::vector<double> times;
+	for (int i = 0; i < repetitions; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (size_t j = 0; j < poses.size(); j++)
+		{
+			auto pose = poses[j];
+			update((uint32_t) (j % DeviceCount), pose);
+			checksum += pose.vecWorldFromDriverTranslation[0];
+		}
+		auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		times.push_back(elapsed / poses.size());
+	}
+
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+int main(int argc, char **argv)
+{
+	int repetitions = argc > 1 ? atoi(argv[1]) : 2000;
+	if (repetitions < 1)
+	{
+		fprintf(stderr, "usage: PoseUpdateBench [repetitions]\n");
+		return 2;
+	}
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> offset(-2.0, 2.0);
+
+	ServerTrackedDeviceProvider driver;
+	static SeqLock<protocol::DeviceTransform> quaternionTransforms[DeviceCount];
+
+	for (uint32_t id = 0; id < DeviceCount; id++)
+	{
+		vr::HmdVector3d_t translation = { { offset(random), offset(random), offset(random) } };
+		protocol::SetDeviceTransform update(id, true, translation, RandomRotation(random), 1.0);
+
+		driver.SetDeviceTransform(update);
+		quaternionTransforms[id].Modify([&](protocol::DeviceTransform &tf) {
+			protocol::ApplyTransformUpdate(tf, update);
+		});
+	}
+
+	std::vector<vr::DriverPose_t> poses;
+	for (size_t i = 0; i < PoseCount; i++)
+		poses.push_back(RandomPose(random));
+
+	double largest = 0.0;
+	for (size_t i = 0; i < poses.size(); i++)
+	{
+		uint32_t id = (uint32_t) (i % DeviceCount);
+		auto matrixPose = poses[i], quaternionPose = poses[i];
+		driver.HandleDevicePoseUpdated(id, matrixPose);
+		QuaternionPoseUpdate(quaternionTransforms[id], quaternionPose);
+
+		for (int axis = 0; axis < 3; axis++)
+			largest = std::max(largest, std::abs(matrixPose.vecWorldFromDriverTranslation[axis] - quaternionPose.vecWorldFromDriverTranslation[axis]));
+	}
+
+	double checksum = 0.0;
+	double quaternion = NanosecondsPerPose(poses, repetitions, checksum, [&](uint32_t id, vr::DriverPose_t &pose) {
+		QuaternionPoseUpdate(quaternionTransforms[id], pose);
+	});
+	double matrix = NanosecondsPerPose(poses, repetitions, checksum, [&](uint32_t id, vr::DriverPose_t &pose) {
+		driver.HandleDevicePoseUpdated(id, pose);
+	});
+
+	printf("%zd poses across %u devices, %d repetitions\n\n", poses.size(), DeviceCount, repetitions);
+	printf("%-12s %10s\n", "path", "ns/pose");
+	printf("%-12s %10.2f\n", "quaternion", quaternion);
+	printf("%-12s %10.2f\n", "matrix", matrix);
+	printf("\nlargest difference %.3g m (checksum %g)\n", largest, checksum);
+
+	if (largest > AgreementTolerance)
+	{
+		fprintf(stderr, "The matrix and quaternion paths disagree by more than %g m\n", AgreementTolerance);
+		return 1;
+	}
+	return 0;
+}
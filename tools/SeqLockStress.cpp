@@ -0,0 +1,135 @@
+// Hammers a SeqLock with writers and readers and checks that no reader ever sees a torn value.
+//
+//   SeqLockStress [seconds] [readers]
+//
+// Every write fills the whole value from one counter, so a value that mixes two writes has
+// fields that disagree. Readers also check that the counter never goes backwards, and the final
+// count must equal the number of writes. Then a writer that stalls halfway through a write checks
+// that TryLoad gives up instead of waiting, as the pose hook relies on.
+
+#include "SeqLock.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Larger than a cache line, so a torn copy is likely if the lock were broken.
+struct Value
+{
+	uint64_t counter;
+	uint64_t copies[15];
+	double negated;
+};
+
+static bool Consistent(const Value &value)
+{
+	for (auto copy : value.copies)
+	{
+		if (copy != value.counter)
+			return false;
+	}
+	return value.negated == -(double) value.counter;
+}
+
+static const int Writers = 2;
+
+int main(int argc, char **argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+	int readerCount = argc > 2 ? atoi(argv[2]) : 4;
+
+	SeqLock<Value> lock;
+	lock.Store(Value{ 0, {}, -0.0 });
+
+	std::atomic<bool> running = { true };
+	std::atomic<uint64_t> torn = { 0 }, backwards = { 0 }, reads = { 0 }, writes = { 0 };
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < Writers; i++)
+	{
+		threads.emplace_back([&] {
+			while (running.load(std::memory_order_relaxed))
+			{
+				lock.Modify([](Value &value) {
+					value.counter++;
+					for (auto &copy : value.copies)
+						copy = value.counter;
+					value.negated = -(double) value.counter;
+				});
+				writes.fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+	}
+
+	for (int i = 0; i < readerCount; i++)
+	{
+		threads.emplace_back([&, i] {
+			uint64_t last = 0, count = 0;
+			while (running.load(std::memory_order_relaxed))
+			{
+				// Half the readers go through the bounded path the driver uses.
+				Value value;
+				if (i % 2 == 0)
+					value = lock.Load();
+				else if (!lock.TryLoad(value, 16))
+					continue;
+
+				if (!Consistent(value))
+					torn.fetch_add(1, std::memory_order_relaxed);
+				if (value.counter < last)
+					backwards.fetch_add(1, std::memory_order_relaxed);
+
+				last = value.counter;
+				count++;
+			}
+			reads.fetch_add(count, std::memory_order_relaxed);
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	running = false;
+	for (auto &thread : threads)
+		thread.join();
+
+	Value final = lock.Load();
+	bool countMatches = final.counter == writes.load();
+
+	printf("%d writers, %d readers, %.1f s: %llu writes, %llu reads, %llu torn, %llu backwards\n",
+		Writers, readerCount, seconds, (unsigned long long) writes.load(), (unsigned long long) reads.load(),
+		(unsigned long long) torn.load(), (unsigned long long) backwards.load());
+
+	// A writer stuck halfway through its write, like a client that died in one.
+	std::atomic<bool> release = { false }, stalled = { false };
+	std::thread staller([&] {
+		lock.Modify([&](Value &value) {
+			value.counter = 0;
+			stalled = true;
+			while (!release)
+				std::this_thread::yield();
+		});
+	});
+
+	while (!stalled)
+		std::this_thread::yield();
+
+	Value value;
+	auto start = std::chrono::steady_clock::now();
+	bool loaded = lock.TryLoad(value, 16);
+	double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	bool odd = (lock.Sequence() & 1) != 0;
+
+	release = true;
+	staller.join();
+
+	printf("stalled writer: TryLoad %s after %.2f us\n", loaded ? "returned a value" : "gave up", elapsed);
+
+	bool failed = torn > 0 || backwards > 0 || !countMatches || loaded || !odd;
+	if (!countMatches)
+		fprintf(stderr, "Final counter %llu doesn't match %llu writes\n", (unsigned long long) final.counter, (unsigned long long) writes.load());
+	if (failed)
+		fprintf(stderr, "FAILED\n");
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#include "SyntheticTrace.h"
+
+#include <cmath>
+
+// vr::TrackingResult_Running_OK, without pulling in OpenVR.
+static const int32_t TrackingResultRunningOK = 200;
+
+SyntheticOptions::SyntheticOptions()
+{
+	rotation = (Eigen::AngleAxisd(0.6, Eigen::Vector3d::UnitY()) * Eigen::AngleAxisd(-0.2, Eigen::Vector3d::UnitX())).toRotationMatrix();
+	translation = Eigen::Vector3d(0.35, -0.12, 1.4);
+	mountRotation = Eigen::AngleAxisd(1.1, Eigen::Vector3d(1, 1, 0).normalized()).toRotationMatrix();
+	mountOffset = Eigen::Vector3d(0.04, -0.02, 0.07);
+}
+
+SyntheticSession::SyntheticSession(const SyntheticOptions &options)
+	: options(options), rng(options.seed), gaussian(0.0, 1.0), uniform(0.0, 1.0)
+{
+}
+
+void SyntheticSession::ReferencePose(double t, Eigen::Matrix3d &rot, Eigen::Vector3d &trans) const
+{
+	const double tau = 2.0 * EIGEN_PI;
+
+	rot = (Eigen::AngleAxisd(1.4 * std::sin(tau * 0.23 * t), Eigen::Vector3d::UnitY())
+		* Eigen::AngleAxisd(0.9 * std::sin(tau * 0.31 * t + 1.0), Eigen::Vector3d::UnitX())
+		* Eigen::AngleAxisd(0.8 * std::sin(tau * 0.17 * t + 2.0), Eigen::Vector3d::UnitZ())).toRotationMatrix();
+
+	trans = Eigen::Vector3d(
+		0.3 * std::sin(tau * 0.11 * t),
+		1.2 + 0.2 * std::sin(tau * 0.19 * t + 0.5),
+		0.3 * std::cos(tau * 0.13 * t)
+	);
+}
+
+void SyntheticSession::AddNoise(Eigen::Matrix3d &rot, Eigen::Vector3d &trans)
+{
+	Eigen::Vector3d axis(gaussian(rng), gaussian(rng), gaussian(rng));
+	double angle = axis.norm() * options.rotationNoise;
+	if (angle > 0.0)
+		rot = Eigen::AngleAxisd(angle, axis.normalized()).toRotationMatrix() * rot;
+
+	trans += options.positionNoise * Eigen::Vector3d(gaussian(rng), gaussian(rng), gaussian(rng));
+}
+
+static void StorePose(TraceDevicePose &out, const Eigen::Matrix3d &rot, const Eigen::Vector3d &trans)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+			out.deviceToAbsoluteTracking[i][j] = (float) rot(i, j);
+		out.deviceToAbsoluteTracking[i][3] = (float) trans(i);
+
+		// The solvers don't look at velocities.
+		out.velocity[i] = 0.0f;
+		out.angularVelocity[i] = 0.0f;
+	}
+
+	out.trackingResult = TrackingResultRunningOK;
+	out.poseIsValid = 1;
+	out.deviceIsConnected = 1;
+}
+
+void SyntheticSession::Generate(TracePhase phase, double duration, const Eigen::Matrix3d &appliedRotation, std::vector<TraceRecord> &records)
+{
+	const Eigen::Matrix3d &calRot = options.rotation;
+	const Eigen::Vector3d &calTrans = options.translation;
+
+	double end = time + duration;
+	for (; time < end; time += 1.0 / options.rate)
+	{
+		TraceRecord record;
+		record.time = time;
+		record.phase = phase;
+
+		Eigen::Matrix3d refRot, targetRot;
+		Eigen::Vector3d refTrans, targetTrans;
+
+		ReferencePose(time, refRot, refTrans);
+		AddNoise(refRot, refTrans);
+		StorePose(record.reference, refRot, refTrans);
+
+		// The target in the reference's tracking space, then taken back into its own.
+		ReferencePose(time - options.latency, targetRot, targetTrans);
+		targetTrans += targetRot * options.mountOffset;
+		targetRot = targetRot * options.mountRotation;
+
+		targetRot = calRot.transpose() * targetRot;
+		targetTrans = calRot.transpose() * (targetTrans - calTrans);
+		AddNoise(targetRot, targetTrans);
+
+		if (uniform(rng) < options.outlierRatio)
+		{
+			// A reflection or occlusion glitch: the pose jumps by tens of centimeters and degrees.
+			Eigen::Vector3d axis(gaussian(rng), gaussian(rng), gaussian(rng));
+			Eigen::Vector3d offset(gaussian(rng), gaussian(rng), gaussian(rng));
+			targetRot = Eigen::AngleAxisd(0.3 + 0.4 * uniform(rng), axis.normalized()).toRotationMatrix() * targetRot;
+			targetTrans += (0.1 + 0.2 * uniform(rng)) * offset.normalized();
+		}
+
+		StorePose(record.target, appliedRotation * targetRot, appliedRotation * targetTrans);
+		records.push_back(record);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Synthetic calibration sessions with a known answer, for measuring the solvers without a headset.
+//
+// The reference device is swung around by a few sinusoids at incommensurate frequencies, so it
+// keeps turning about changing axes, and the target rides on it at a fixed mount. Both poses get
+// Gaussian noise, a fraction of target poses is replaced by tracking glitches, and the target can
+// lag behind the reference.
+
+#include "PoseTrace.h"
+
+#include <random>
+
+struct SyntheticOptions
+{
+	// The calibration to recover, taking the target's tracking space to the reference's.
+	Eigen::Matrix3d rotation;
+	Eigen::Vector3d translation;
+
+	// Where the target sits on the reference device, in the reference device's frame.
+	Eigen::Matrix3d mountRotation;
+	Eigen::Vector3d mountOffset;
+
+	double rate = 250.0; // Pose pairs per second.
+	double positionNoise = 0.0005; // Standard deviation, meters.
+	double rotationNoise = 0.002; // Standard deviation, radians.
+	double outlierRatio = 0.0; // Fraction of target poses that are glitches.
+	double latency = 0.0; // How long the target pose lags behind the reference, seconds.
+	uint32_t seed = 1;
+
+	SyntheticOptions();
+};
+
+class SyntheticSession
+{
+public:
+	explicit SyntheticSession(const SyntheticOptions &options);
+
+	// Appends duration seconds of pose pairs, continuing the motion where the last call stopped.
+	// The simulated driver applies appliedRotation to the target, as it does during the
+	// translation phase of a sequential calibration.
+	void Generate(TracePhase phase, double duration, const Eigen::Matrix3d &appliedRotation, std::vector<TraceRecord> &records);
+
+private:
+	void ReferencePose(double t, Eigen::Matrix3d &rot, Eigen::Vector3d &trans) const;
+	void AddNoise(Eigen::Matrix3d &rot, Eigen::Vector3d &trans);
+
+	SyntheticOptions options;
+	std::mt19937 rng;
+	std::normal_distribution<double> gaussian;
+	std::uniform_real_distribution<double> uniform;
+	double time = 0.0;
+};
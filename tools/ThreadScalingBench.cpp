@@ -0,0 +1,175 @@
+// Times the parts of the rotation solve that run on the solver thread pool at 1, 2, 4 and 8
+// threads: folding a batch of samples into the RotationAccumulator, as a replay or the joint
+// solver does, and the robust solve, which collects every pairwise delta.
+//
+//   ThreadScalingBench [--trace PATH] [sample counts...]
+//
+// The samples come from a synthetic rotation phase, or with --trace from the valid rotation or
+// joint phase records of a recorded session, taken in order. Without sample counts a trace is
+// used whole.
+//
+// Tiles are reduced in a fixed order, so every thread count must give bit identical results; the
+// tool exits with an error if they don't.
+
+#include "SyntheticTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const unsigned ThreadCounts[] = { 1, 2, 4, 8 };
+static const int Repetitions = 5;
+
+template<typename Fn>
+static double MedianSeconds(Fn fn)
+{
+	std::vector<double> times;
+	for (int i = 0; i < Repetitions; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+// The first count samples of the records the rotation solvers would use.
+static std::vector<Sample> RotationSamples(const std::vector<TraceRecord> &records, size_t count)
+{
+	std::vector<Sample> samples;
+	for (size_t i = 0; i < records.size() && samples.size() < count; i++)
+	{
+		auto &record = records[i];
+		if (record.phase != TracePhase::Rotation && record.phase != TracePhase::Joint)
+			continue;
+		if (!record.reference.poseIsValid || !record.target.poseIsValid)
+			continue;
+
+		samples.push_back(Sample(Pose(record.reference.deviceToAbsoluteTracking), Pose(record.target.deviceToAbsoluteTracking)));
+	}
+	return samples;
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: ThreadScalingBench [--trace PATH] [sample counts...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	std::string tracePath;
+	std::vector<size_t> counts;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--trace" && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (arg.compare(0, 2, "--") == 0 || atoi(argv[i]) < 2)
+			Usage();
+		else
+			counts.push_back((size_t) atoi(argv[i]));
+	}
+
+	PoseTrace trace;
+	if (!tracePath.empty())
+	{
+		try
+		{
+			trace = LoadPoseTrace(tracePath);
+		}
+		catch (const std::exception &e)
+		{
+			fprintf(stderr, "%s\n", e.what());
+			return 1;
+		}
+
+		if (counts.empty())
+			counts = { trace.records.size() };
+	}
+	else if (counts.empty())
+	{
+		counts = { 250, 500, 1000 };
+	}
+
+	printf("%u hardware threads\n", std::thread::hardware_concurrency());
+	if (!tracePath.empty())
+		printf("%s: %zd records\n", tracePath.c_str(), trace.records.size());
+	printf("\n%7s %7s %12s %8s %12s %8s\n", "samples", "threads", "accum ms", "speedup", "robust ms", "speedup");
+
+	SyntheticOptions options;
+	bool deterministic = true;
+
+	for (size_t count : counts)
+	{
+		std::vector<Sample> samples;
+		if (!tracePath.empty())
+		{
+			samples = RotationSamples(trace.records, count);
+		}
+		else
+		{
+			std::vector<TraceRecord> records;
+			SyntheticSession session(options);
+			session.Generate(TracePhase::Rotation, count / options.rate, Eigen::Matrix3d::Identity(), records);
+			samples = RotationSamples(records, count);
+		}
+
+		if (samples.size() < 2)
+		{
+			fprintf(stderr, "Not enough valid rotation samples to solve\n");
+			return 1;
+		}
+
+		double baseAccumulate = 0.0, baseRobust = 0.0;
+		Eigen::Matrix3d baseSolution = Eigen::Matrix3d::Zero(), baseRobustSolution = Eigen::Matrix3d::Zero();
+
+		for (unsigned threads : ThreadCounts)
+		{
+			SetSolverThreadCount(threads);
+
+			RotationAccumulator accumulator;
+			double accumulate = MedianSeconds([&] {
+				accumulator = RotationAccumulator();
+				accumulator.AddSamples(samples.data(), samples.size());
+			});
+
+			Eigen::Matrix3d robustSolution;
+			std::atomic<bool> cancelled = { false };
+			double inlierRatio;
+			double robust = MedianSeconds([&] {
+				robustSolution = SolveRobust(accumulator, samples, cancelled, inlierRatio);
+			});
+
+			Eigen::Matrix3d solution = accumulator.Solve();
+			if (threads == ThreadCounts[0])
+			{
+				baseAccumulate = accumulate;
+				baseRobust = robust;
+				baseSolution = solution;
+				baseRobustSolution = robustSolution;
+			}
+			else if (solution != baseSolution || robustSolution != baseRobustSolution)
+			{
+				deterministic = false;
+			}
+
+			printf("%7zd %7u %12.3f %7.2fx %12.3f %7.2fx\n", samples.size(), threads,
+				accumulate * 1000.0, baseAccumulate / accumulate, robust * 1000.0, baseRobust / robust);
+		}
+	}
+
+	if (!deterministic)
+	{
+		fprintf(stderr, "Results differ between thread counts\n");
+		return 1;
+	}
+	return 0;
+}
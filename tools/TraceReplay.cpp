@@ -0,0 +1,311 @@
+// Replays pose traces through the calibration solvers, and measures them on synthetic sessions.
+//
+//   TraceReplay [--samples N] trace...
+//     Solves each recorded session with and without the robust solver.
+//
+//   TraceReplay [--samples N] [synthetic options] [--write PATH] [--check]
+//     Generates a session with a known calibration and runs it through every solver mode, the way
+//     a live calibration would: for the sequential modes, the translation phase is generated with
+//     the rotation estimated from the rotation phase applied to the target, as the driver does.
+//     Each mode also runs with a sample taken every FixedSampleInterval instead of the coverage
+//     selection, for comparison. --write saves the sequential session as a trace file. --check
+//     exits with an error when a mode misses the known calibration by more than the tolerances
+//     below, when the coverage selection is worse than the fixed interval by more than the match
+//     margins, or when it doesn't take substantially fewer pairs. The least squares modes are only
+//     held to the accuracy checks when there are no outliers.
+
+#include "AllocationCounter.h"
+#include "SyntheticTrace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static const double RotationTolerance = 0.5; // Degrees.
+static const double TranslationTolerance = 0.005; // Meters.
+
+// How much worse than the fixed interval selection the coverage selection may do: this factor,
+// since it takes fewer pairs and noise averages out over fewer of them, plus a margin.
+static const double MatchFactor = 2.0;
+static const double RotationMatch = 0.05; // Degrees.
+static const double TranslationMatch = 0.001; // Meters.
+
+// The most pairs the coverage selection may take, as a share of the fixed interval's.
+static const double MaxPairShare = 0.8;
+
+struct SolverMode
+{
+	const char *name;
+	bool joint;
+	bool robust;
+};
+
+static const SolverMode SolverModes[] = {
+	{ "sequential", false, false },
+	{ "sequential robust", false, true },
+	{ "joint", true, false },
+	{ "joint robust", true, true },
+};
+
+static double Milliseconds(double seconds)
+{
+	return seconds * 1000.0;
+}
+
+static double AngleBetween(const Eigen::Matrix3d &a, const Eigen::Matrix3d &b)
+{
+	return Eigen::AngleAxisd(a * b.transpose()).angle() * 180.0 / EIGEN_PI;
+}
+
+static void PrintTimingHeader()
+{
+	printf("%-18s %7s %6s %8s %8s %8s %8s %8s %8s %10s\n",
+		"mode", "samples", "inlier", "select", "rotate", "transl", "joint", "total", "allocs", "alloc KB");
+}
+
+static void PrintTiming(const char *name, const ReplayResult &result, double total, const AllocationCount &allocations)
+{
+	printf("%-18s %7zd %5.1f%% %6.2fms %6.2fms %6.2fms %6.2fms %6.2fms %8zd %10.1f\n",
+		name, result.sampleCount, result.inlierRatio * 100.0,
+		Milliseconds(result.selectionTime), Milliseconds(result.rotationTime),
+		Milliseconds(result.translationTime), Milliseconds(result.jointTime), Milliseconds(total),
+		allocations.count, allocations.bytes / 1024.0);
+}
+
+// Replays the trace, timing the whole call and counting its allocations.
+static ReplayResult TimedReplay(const PoseTrace &trace, bool robust, size_t sampleCount, double &total, AllocationCount &allocations,
+	ReplaySelection selection = ReplaySelection::Coverage)
+{
+	auto before = Allocations();
+	auto start = std::chrono::steady_clock::now();
+
+	auto result = ReplayPoseTrace(trace, robust, sampleCount, selection);
+
+	total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	allocations = Allocations() - before;
+	return result;
+}
+
+static PoseTrace SyntheticTrace(const SyntheticOptions &options, const SolverMode &mode, size_t sampleCount, ReplaySelection selection)
+{
+	PoseTrace trace;
+	trace.header.referenceSerial = "synthetic-reference";
+	trace.header.referenceTrackingSystem = "synthetic";
+	trace.header.targetSerial = "synthetic-target";
+	trace.header.targetTrackingSystem = "synthetic";
+
+	// Long enough for a phase to reach its sample count at the fixed interval.
+	double duration = sampleCount * FixedSampleInterval + 1.0;
+	Eigen::Matrix3d identity = Eigen::Matrix3d::Identity();
+
+	SyntheticSession session(options);
+	if (mode.joint)
+	{
+		session.Generate(TracePhase::Joint, duration, identity, trace.records);
+		return trace;
+	}
+
+	session.Generate(TracePhase::Rotation, duration, identity, trace.records);
+	auto rotation = ReplayPoseTrace(trace, mode.robust, sampleCount, selection).estimate.rot;
+
+	session.Generate(TracePhase::Transition, 0.1, rotation, trace.records);
+	session.Generate(TracePhase::Translation, duration, rotation, trace.records);
+	return trace;
+}
+
+static bool WriteTrace(const PoseTrace &trace, const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	auto header = EncodeTraceHeader(trace.header);
+	fwrite(header.data(), 1, header.size(), file);
+	fwrite(trace.records.data(), sizeof(TraceRecord), trace.records.size(), file);
+	return fclose(file) == 0;
+}
+
+struct SyntheticRun
+{
+	ReplayResult result;
+	double rotationError, translationError; // Degrees and meters.
+};
+
+static SyntheticRun RunSyntheticMode(const SyntheticOptions &options, const SolverMode &mode, size_t sampleCount, ReplaySelection selection,
+	const std::string &writePath, double &total, AllocationCount &allocations)
+{
+	auto trace = SyntheticTrace(options, mode, sampleCount, selection);
+	if (!writePath.empty() && !WriteTrace(trace, writePath))
+		fprintf(stderr, "Could not write %s\n", writePath.c_str());
+
+	SyntheticRun run;
+	run.result = TimedReplay(trace, mode.robust, sampleCount, total, allocations, selection);
+	run.rotationError = AngleBetween(run.result.estimate.rot, options.rotation);
+	run.translationError = (run.result.estimate.trans - options.translation).norm();
+	return run;
+}
+
+static int RunSynthetic(const SyntheticOptions &options, size_t sampleCount, const std::string &writePath, bool check)
+{
+	printf("Synthetic session: %zd samples per phase at %.0f Hz, noise %.2f mm / %.3f deg, %.0f%% outliers, %.1f ms latency\n\n",
+		sampleCount, options.rate, options.positionNoise * 1000.0, (double) (options.rotationNoise * 180.0 / EIGEN_PI),
+		options.outlierRatio * 100.0, options.latency * 1000.0);
+
+	// Each mode with the coverage selection a live calibration uses, and with a sample every
+	// FixedSampleInterval as before it, which should take more pairs for the same accuracy.
+	printf("%-18s %7s %12s %12s   %7s %12s %12s\n", "", "", "coverage", "", "", "fixed", "");
+	printf("%-18s %7s %12s %12s   %7s %12s %12s\n", "mode", "pairs", "rot err deg", "trans err mm", "pairs", "rot err deg", "trans err mm");
+
+	std::vector<ReplayResult> results;
+	std::vector<double> totals;
+	std::vector<AllocationCount> allocations;
+	bool failed = false;
+
+	for (auto &mode : SolverModes)
+	{
+		double total, fixedTotal;
+		AllocationCount allocated, fixedAllocated;
+		auto coverage = RunSyntheticMode(options, mode, sampleCount, ReplaySelection::Coverage,
+			!mode.joint && !mode.robust ? writePath : std::string(), total, allocated);
+		auto fixed = RunSyntheticMode(options, mode, sampleCount, ReplaySelection::FixedInterval, std::string(), fixedTotal, fixedAllocated);
+
+		bool held = mode.robust || options.outlierRatio == 0.0;
+		bool accurate = coverage.rotationError <= RotationTolerance && coverage.translationError <= TranslationTolerance;
+		bool matched = coverage.rotationError <= fixed.rotationError * MatchFactor + RotationMatch
+			&& coverage.translationError <= fixed.translationError * MatchFactor + TranslationMatch;
+		bool fewer = coverage.result.sampleCount <= fixed.result.sampleCount * MaxPairShare;
+
+		const char *verdict = "";
+		if (check && held && !accurate)
+			verdict = "  FAILED: inaccurate";
+		else if (check && held && !matched)
+			verdict = "  FAILED: worse than fixed";
+		else if (check && !fewer)
+			verdict = "  FAILED: too many pairs";
+		if (*verdict)
+			failed = true;
+
+		printf("%-18s %7zd %12.4f %12.3f   %7zd %12.4f %12.3f%s\n", mode.name,
+			coverage.result.sampleCount, coverage.rotationError, coverage.translationError * 1000.0,
+			fixed.result.sampleCount, fixed.rotationError, fixed.translationError * 1000.0, verdict);
+
+		results.push_back(coverage.result);
+		totals.push_back(total);
+		allocations.push_back(allocated);
+	}
+
+	printf("\n");
+	PrintTimingHeader();
+	for (size_t i = 0; i < results.size(); i++)
+		PrintTiming(SolverModes[i].name, results[i], totals[i], allocations[i]);
+
+	return failed ? 1 : 0;
+}
+
+static int RunTrace(const std::string &path, size_t sampleCount)
+{
+	PoseTrace trace;
+	try
+	{
+		trace = LoadPoseTrace(path);
+	}
+	catch (const std::exception &e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+	printf("%s: %zd records\n", path.c_str(), trace.records.size());
+	printf("  reference %s (%s), target %s (%s)\n\n",
+		trace.header.referenceSerial.c_str(), trace.header.referenceTrackingSystem.c_str(),
+		trace.header.targetSerial.c_str(), trace.header.targetTrackingSystem.c_str());
+
+	printf("%-18s %8s %8s %8s %8s %8s %8s\n", "mode", "yaw", "pitch", "roll", "x cm", "y cm", "z cm");
+
+	ReplayResult results[2];
+	double totals[2];
+	AllocationCount allocations[2];
+
+	for (int robust = 0; robust < 2; robust++)
+	{
+		results[robust] = TimedReplay(trace, robust != 0, sampleCount, totals[robust], allocations[robust]);
+
+		auto euler = EulerFromRotation(results[robust].estimate.rot);
+		Eigen::Vector3d transcm = results[robust].estimate.trans * 100.0;
+		printf("%-18s %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n", robust ? "robust" : "least squares",
+			euler[1], euler[2], euler[0], transcm[0], transcm[1], transcm[2]);
+	}
+
+	printf("\n");
+	PrintTimingHeader();
+	for (int robust = 0; robust < 2; robust++)
+		PrintTiming(robust ? "robust" : "least squares", results[robust], totals[robust], allocations[robust]);
+	printf("\n");
+	return 0;
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: TraceReplay [--samples N] trace...\n"
+		"       TraceReplay [--samples N] [--rate HZ] [--noise MM] [--rotation-noise DEG]\n"
+		"                   [--outliers FRACTION] [--latency MS] [--seed N] [--write PATH] [--check]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	SyntheticOptions options;
+	size_t sampleCount = 250;
+	std::string writePath;
+	bool check = false;
+	std::vector<std::string> traces;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		auto value = [&]() -> double {
+			if (++i >= argc)
+				Usage();
+			return atof(argv[i]);
+		};
+
+		if (arg == "--samples")
+			sampleCount = (size_t) value();
+		else if (arg == "--rate")
+			options.rate = value();
+		else if (arg == "--noise")
+			options.positionNoise = value() / 1000.0;
+		else if (arg == "--rotation-noise")
+			options.rotationNoise = value() * EIGEN_PI / 180.0;
+		else if (arg == "--outliers")
+			options.outlierRatio = value();
+		else if (arg == "--latency")
+			options.latency = value() / 1000.0;
+		else if (arg == "--seed")
+			options.seed = (uint32_t) value();
+		else if (arg == "--write" && i + 1 < argc)
+			writePath = argv[++i];
+		else if (arg == "--check")
+			check = true;
+		else if (arg.compare(0, 2, "--") == 0)
+			Usage();
+		else
+			traces.push_back(arg);
+	}
+
+	if (sampleCount < 2 || !(options.rate > 0.0))
+		Usage();
+
+	if (traces.empty())
+		return RunSynthetic(options, sampleCount, writePath, check);
+
+	int status = 0;
+	for (auto &path : traces)
+		status |= RunTrace(path, sampleCount);
+	return status;
+}
@@ -0,0 +1,143 @@
+// Times the translation solve of the constant size TranslationAccumulator against the pairwise
+// solve it replaced, which built a dense row for every pair of samples and solved them by SVD.
+//
+//   TranslationBench [sample counts...]
+//
+// Both solve the same least squares problem, so the tool exits with an error if they disagree.
+
+#include "AllocationCounter.h"
+#include "SyntheticTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// How far apart the two solutions may be, in meters.
+static const double AgreementTolerance = 1e-6;
+
+static const int Repetitions = 5;
+
+// The solve as it was before TranslationAccumulator: two rows of three equations per pair.
+static Eigen::Vector3d PairwiseTranslation(const std::vector<Sample> &samples)
+{
+	std::vector<std::pair<Eigen::Vector3d, Eigen::Matrix3d>> deltas;
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		for (size_t j = 0; j < i; j++)
+		{
+			auto QAi = samples[i].ref.rot.transpose();
+			auto QAj = samples[j].ref.rot.transpose();
+			auto dQA = QAj - QAi;
+			auto CA = QAj * (samples[j].ref.trans - samples[j].target.trans) - QAi * (samples[i].ref.trans - samples[i].target.trans);
+			deltas.push_back(std::make_pair(CA, dQA));
+
+			auto QBi = samples[i].target.rot.transpose();
+			auto QBj = samples[j].target.rot.transpose();
+			auto dQB = QBj - QBi;
+			auto CB = QBj * (samples[j].ref.trans - samples[j].target.trans) - QBi * (samples[i].ref.trans - samples[i].target.trans);
+			deltas.push_back(std::make_pair(CB, dQB));
+		}
+	}
+
+	Eigen::VectorXd constants(deltas.size() * 3);
+	Eigen::MatrixXd coefficients(deltas.size() * 3, 3);
+
+	for (size_t i = 0; i < deltas.size(); i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			constants(i * 3 + axis) = deltas[i].first(axis);
+			coefficients.row(i * 3 + axis) = deltas[i].second.row(axis);
+		}
+	}
+
+	return coefficients.bdcSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(constants);
+}
+
+static Eigen::Vector3d AccumulatedTranslation(const std::vector<Sample> &samples)
+{
+	TranslationAccumulator accumulator;
+	for (auto &sample : samples)
+		accumulator.AddSample(sample);
+	return accumulator.Solve();
+}
+
+struct Measurement
+{
+	Eigen::Vector3d result;
+	double seconds; // Median over the repetitions.
+	AllocationCount allocations;
+};
+
+template<typename Solve>
+static Measurement Measure(const std::vector<Sample> &samples, Solve solve)
+{
+	Measurement measurement;
+	std::vector<double> times;
+
+	for (int i = 0; i < Repetitions; i++)
+	{
+		auto before = Allocations();
+		auto start = std::chrono::steady_clock::now();
+
+		measurement.result = solve(samples);
+
+		times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		measurement.allocations = Allocations() - before;
+	}
+
+	std::sort(times.begin(), times.end());
+	measurement.seconds = times[times.size() / 2];
+	return measurement;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<size_t> counts;
+	for (int i = 1; i < argc; i++)
+		counts.push_back((size_t) atoi(argv[i]));
+	if (counts.empty())
+		counts = { 100, 250, 500, 1000 };
+
+	SyntheticOptions options;
+	bool agreed = true;
+
+	printf("%7s %8s %12s %12s %8s %12s %12s %10s %10s\n", "samples", "pairs",
+		"pairwise ms", "accum ms", "speedup", "pairwise KB", "accum KB", "diff mm", "error mm");
+
+	for (size_t count : counts)
+	{
+		// The translation phase with the exact rotation applied, so the answer is options.translation.
+		std::vector<TraceRecord> records;
+		SyntheticSession session(options);
+		session.Generate(TracePhase::Translation, count / options.rate, options.rotation, records);
+
+		std::vector<Sample> samples;
+		for (size_t i = 0; i < records.size() && samples.size() < count; i++)
+			samples.push_back(Sample(Pose(records[i].reference.deviceToAbsoluteTracking), Pose(records[i].target.deviceToAbsoluteTracking)));
+
+		auto pairwise = Measure(samples, PairwiseTranslation);
+		auto accumulated = Measure(samples, AccumulatedTranslation);
+
+		double difference = (pairwise.result - accumulated.result).norm();
+		double error = (accumulated.result - options.translation).norm();
+		if (difference > AgreementTolerance)
+			agreed = false;
+
+		printf("%7zd %8zd %12.3f %12.3f %7.0fx %12.1f %12.1f %10.6f %10.3f\n",
+			samples.size(), samples.size() * (samples.size() - 1) / 2,
+			pairwise.seconds * 1000.0, accumulated.seconds * 1000.0, pairwise.seconds / accumulated.seconds,
+			pairwise.allocations.bytes / 1024.0, accumulated.allocations.bytes / 1024.0,
+			difference * 1000.0, error * 1000.0);
+	}
+
+	if (!agreed)
+	{
+		fprintf(stderr, "The accumulated and pairwise solutions disagree by more than %g m\n", AgreementTolerance);
+		return 1;
+	}
+	return 0;
+}